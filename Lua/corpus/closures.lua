@@ -0,0 +1,44 @@
+-- corpus/closures.lua
+-- 闭包创建, 上值读写与高阶函数
+local function counter()
+    local c = 0
+    return function(step)
+        c = c + step
+        return c
+    end
+end
+
+local function compose(f, g)
+    return function(x)
+        return f(g(x))
+    end
+end
+
+return function(n)
+    n = n or 5000
+    local total = 0
+    for i = 1, n do
+        local inc = counter()
+        inc(i)
+        total = total + inc(1)
+    end
+
+    local f = compose(function(x) return x + 1 end, function(x) return x * 2 end)
+    for i = 1, n do
+        total = total + f(i)
+    end
+
+    -- 多个闭包共享同一个上值
+    local shared = 0
+    local fns = {}
+    for i = 1, 16 do
+        fns[i] = function()
+            shared = shared + i
+            return shared
+        end
+    end
+    for i = 1, n do
+        total = total + fns[i % 16 + 1]()
+    end
+    return total
+end
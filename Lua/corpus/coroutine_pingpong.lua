@@ -0,0 +1,31 @@
+-- corpus/coroutine_pingpong.lua
+-- 协程之间来回切换 (resume/yield) 与生产者/消费者
+return function(n)
+    n = n or 5000
+    local ping = coroutine.create(function(x)
+        while true do
+            x = coroutine.yield(x + 1)
+        end
+    end)
+    local value = 0
+    for _ = 1, n do
+        local _, v = coroutine.resume(ping, value)
+        value = v
+    end
+
+    local producer = coroutine.wrap(function()
+        for i = 1, n do
+            coroutine.yield(i)
+        end
+        return nil
+    end)
+    local sum = 0
+    while true do
+        local v = producer()
+        if v == nil then
+            break
+        end
+        sum = sum + v
+    end
+    return value + sum
+end
@@ -0,0 +1,31 @@
+-- corpus/ffi_structs.lua
+-- FFI 结构体数组的顺序读写
+local ffi = require("ffi")
+if not pcall(ffi.typeof, "lp_particle_t") then
+    ffi.cdef[[
+        typedef struct { double x, y, z; int32_t id; } lp_particle_t;
+    ]]
+end
+
+return function(n)
+    n = n or 5000
+    local particles = ffi.new("lp_particle_t[?]", n)
+    for i = 0, n - 1 do
+        local p = particles[i]
+        p.x = i
+        p.y = i * 0.5
+        p.z = -i
+        p.id = i
+    end
+
+    local sum = 0
+    for _ = 1, 4 do
+        for i = 0, n - 1 do
+            local p = particles[i]
+            p.x = p.x + p.y * 0.01
+            p.z = p.z + p.x * 0.001
+            sum = sum + p.z + p.id
+        end
+    end
+    return sum
+end
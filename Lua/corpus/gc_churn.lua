@@ -0,0 +1,26 @@
+-- corpus/gc_churn.lua
+-- 大量短命对象, 少量长命对象与弱表缓存
+return function(n)
+    n = n or 5000
+    local keep = {}
+    local sum = 0
+    for i = 1, n do
+        local obj = { id = i, name = "obj" .. i, tags = { i, i + 1, i + 2 } }
+        sum = sum + #obj.tags + obj.id + #obj.name
+        if i % 64 == 0 then
+            keep[#keep + 1] = obj
+        end
+    end
+
+    local cache = setmetatable({}, { __mode = "v" })
+    for i = 1, n do
+        cache[i] = { i, tostring(i) }
+    end
+    for i = 1, n, 7 do
+        local entry = cache[i]
+        if entry then
+            sum = sum + entry[1]
+        end
+    end
+    return sum + #keep
+end
@@ -0,0 +1,176 @@
+-- corpus/json_codec.lua
+-- 类 JSON 的编码与解码 (递归下降解析)
+local encode
+
+local function encodeString(s)
+    local escaped = string.gsub(s, '[%c"\\]', function(c)
+        return string.format("\\u%04x", string.byte(c))
+    end)
+    return '"' .. escaped .. '"'
+end
+
+local function encodeTable(t, buf)
+    if #t > 0 or next(t) == nil then
+        buf[#buf + 1] = "["
+        for i = 1, #t do
+            if i > 1 then
+                buf[#buf + 1] = ","
+            end
+            encode(t[i], buf)
+        end
+        buf[#buf + 1] = "]"
+    else
+        buf[#buf + 1] = "{"
+        local first = true
+        for k, v in pairs(t) do
+            if not first then
+                buf[#buf + 1] = ","
+            end
+            first = false
+            buf[#buf + 1] = encodeString(tostring(k))
+            buf[#buf + 1] = ":"
+            encode(v, buf)
+        end
+        buf[#buf + 1] = "}"
+    end
+end
+
+encode = function(v, buf)
+    local tp = type(v)
+    if tp == "table" then
+        encodeTable(v, buf)
+    elseif tp == "string" then
+        buf[#buf + 1] = encodeString(v)
+    elseif tp == "number" then
+        buf[#buf + 1] = string.format("%.14g", v)
+    elseif tp == "boolean" then
+        buf[#buf + 1] = v and "true" or "false"
+    else
+        buf[#buf + 1] = "null"
+    end
+end
+
+local function skip(s, i)
+    return string.find(s, "%S", i) or #s + 1
+end
+
+local function decodeString(s, i)
+    local buf = {}
+    local j = i + 1
+    while true do
+        local k = string.find(s, '["\\]', j)
+        if not k then
+            error("unterminated string at " .. i)
+        end
+        buf[#buf + 1] = string.sub(s, j, k - 1)
+        if string.sub(s, k, k) == '"' then
+            return table.concat(buf), k + 1
+        end
+        local e = string.sub(s, k + 1, k + 1)
+        if e == "u" then
+            buf[#buf + 1] = string.char(tonumber(string.sub(s, k + 2, k + 5), 16) % 256)
+            j = k + 6
+        else
+            local map = { n = "\n", t = "\t", r = "\r", b = "\b", f = "\f" }
+            buf[#buf + 1] = map[e] or e
+            j = k + 2
+        end
+    end
+end
+
+local decodeValue
+
+local function decodeArray(s, i)
+    local arr = {}
+    i = skip(s, i + 1)
+    if string.sub(s, i, i) == "]" then
+        return arr, i + 1
+    end
+    while true do
+        local v
+        v, i = decodeValue(s, i)
+        arr[#arr + 1] = v
+        i = skip(s, i)
+        local c = string.sub(s, i, i)
+        if c == "]" then
+            return arr, i + 1
+        elseif c ~= "," then
+            error("expected ',' or ']' at " .. i)
+        end
+        i = i + 1
+    end
+end
+
+local function decodeObject(s, i)
+    local obj = {}
+    i = skip(s, i + 1)
+    if string.sub(s, i, i) == "}" then
+        return obj, i + 1
+    end
+    while true do
+        local key, v
+        key, i = decodeString(s, skip(s, i))
+        i = skip(s, i)
+        if string.sub(s, i, i) ~= ":" then
+            error("expected ':' at " .. i)
+        end
+        v, i = decodeValue(s, i + 1)
+        obj[key] = v
+        i = skip(s, i)
+        local c = string.sub(s, i, i)
+        if c == "}" then
+            return obj, i + 1
+        elseif c ~= "," then
+            error("expected ',' or '}' at " .. i)
+        end
+        i = i + 1
+    end
+end
+
+decodeValue = function(s, i)
+    i = skip(s, i)
+    local c = string.sub(s, i, i)
+    if c == "{" then
+        return decodeObject(s, i)
+    elseif c == "[" then
+        return decodeArray(s, i)
+    elseif c == '"' then
+        return decodeString(s, i)
+    elseif string.sub(s, i, i + 3) == "true" then
+        return true, i + 4
+    elseif string.sub(s, i, i + 4) == "false" then
+        return false, i + 5
+    elseif string.sub(s, i, i + 3) == "null" then
+        return nil, i + 4
+    end
+    local num = string.match(s, "^-?%d+%.?%d*[eE]?[-+]?%d*", i)
+    if not num then
+        error("unexpected character '" .. c .. "' at " .. i)
+    end
+    return tonumber(num), i + #num
+end
+
+return function(n)
+    n = n or 500
+    local records = {}
+    for i = 1, n do
+        records[i] = {
+            id = i,
+            name = "user" .. i,
+            score = i * 1.5,
+            active = (i % 2 == 0),
+            tags = { "a", "b", tostring(i) },
+        }
+    end
+    local buf = {}
+    encode(records, buf)
+    local text = table.concat(buf)
+    local decoded = decodeValue(text, 1)
+
+    local sum = 0
+    for i = 1, #decoded do
+        local r = decoded[i]
+        sum = sum + r.id + r.score + #r.tags
+    end
+    return sum + #text
+end
@@ -0,0 +1,35 @@
+-- corpus/pcall_errors.lua
+-- 以 pcall/xpcall 处理的错误路径 (字符串错误, 表错误, 带 traceback)
+local function risky(i)
+    if i % 3 == 0 then
+        error("bad value " .. i)
+    end
+    if i % 5 == 0 then
+        error({ code = i })
+    end
+    return i
+end
+
+return function(n)
+    n = n or 5000
+    local okSum, strErr, tblErr = 0, 0, 0
+    for i = 1, n do
+        local ok, res = pcall(risky, i)
+        if ok then
+            okSum = okSum + res
+        elseif type(res) == "table" then
+            tblErr = tblErr + res.code
+        else
+            strErr = strErr + #res
+        end
+    end
+
+    local traced = 0
+    for i = 1, math.floor(n / 10) do
+        local ok = xpcall(function() return risky(i * 3) end, debug.traceback)
+        if not ok then
+            traced = traced + 1
+        end
+    end
+    return okSum + strErr + tblErr + traced
+end
@@ -0,0 +1,39 @@
+-- corpus/string_build.lua
+-- 字符串拼接, 格式化与模式匹配
+return function(n)
+    n = n or 2000
+    local parts = {}
+    for i = 1, n do
+        parts[#parts + 1] = string.format("key%d=%s;", i, tostring(i * 7))
+    end
+    local line = table.concat(parts)
+
+    local sum = 0
+    for k, v in string.gmatch(line, "key(%d+)=(%d+);") do
+        sum = sum + tonumber(k) + tonumber(v)
+    end
+
+    local replaced, count = string.gsub(line, "key", "k")
+    local found, pos = 0, 1
+    while true do
+        local first, last = string.find(replaced, "k%d+=", pos)
+        if not first then
+            break
+        end
+        found = found + 1
+        pos = last + 1
+    end
+
+    -- 逐字符 .. 拼接, 常见于业务代码中的日志与协议拼装
+    local s = ""
+    for i = 1, math.min(n, 512) do
+        s = s .. string.char(65 + i % 26)
+    end
+    local upper = string.upper(string.rep(s, 4))
+    local words = 0
+    for _ in string.gmatch(string.lower(upper), "%a%a%a") do
+        words = words + 1
+    end
+
+    return sum + count + found + words
+end
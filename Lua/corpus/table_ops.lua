@@ -0,0 +1,43 @@
+-- corpus/table_ops.lua
+-- 数组插入/删除, 哈希读写与遍历
+return function(n)
+    n = n or 5000
+    local list = {}
+    for i = 1, n do
+        table.insert(list, i)
+    end
+    for _ = 1, math.floor(n / 2) do
+        table.remove(list)
+    end
+    -- 头部插入/删除需要整体搬移
+    for i = 1, 64 do
+        table.insert(list, 1, -i)
+    end
+    for _ = 1, 64 do
+        table.remove(list, 1)
+    end
+
+    local map = {}
+    for i = 1, n do
+        map["id_" .. i] = i
+    end
+    local sum = 0
+    for i = 1, n do
+        local v = map["id_" .. (i % n + 1)]
+        if v then
+            sum = sum + v
+        end
+    end
+    for k, v in pairs(map) do
+        if v % 3 == 0 then
+            map[k] = nil
+        end
+    end
+    local left = 0
+    for _ in pairs(map) do
+        left = left + 1
+    end
+
+    table.sort(list, function(a, b) return a > b end)
+    return sum + left + #list + (list[1] or 0)
+end
@@ -0,0 +1,12 @@
+-- hook_events.lua
+-- 钩子事件吞吐量基准的入口: 循环调用空函数, 测量的是每个调用/返回事件的记录开销
+local function empty()
+end
+
+function hook_events(args)
+	local n = tonumber(args) or 10000
+	for i = 1, n do
+		empty()
+	end
+	return n
+end
@@ -1,7 +1,9 @@
 -- mod1.lua
-return function()
+-- n: 外层循环次数 (负载规模), 缺省 10000
+return function(n)
+    n = n or 10000
     local s = 0
-    for i = 1, 10000 do
+    for i = 1, n do
         for j = 1, 10 do
             s = s + i * j
         end
@@ -0,0 +1,5 @@
+-- startup.lua
+-- 启动时间基准的入口: 只做一次最小的调用, 测量的是虚拟机创建到第一次调用返回的开销
+function startup(args)
+	return 1
+end
@@ -0,0 +1,707 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "LatencyHistogram.hpp"
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: 帧的类别, 由 lua_Debug::what 决定, FFI 调用另外区分
+ *     类别体现在帧名的位置部分, 折叠栈文件不需要额外的列: C 函数为 "name ([C])", FFI 调用为 "name ([FFI])",
+ *     主 chunk 的定义行为 0 ("name (file.lua:0)"), 其余为 Lua 函数
+ *     被 JIT 编译的代码不触发钩子, 无法与解释执行的 Lua 字节码区分, 都计入 LUA
+ */
+enum class FrameCategory : uint8_t {
+	LUA = 0,
+	C,
+	FFI,
+	MAIN
+};
+inline constexpr size_t FrameCategoryCount = 4;
+
+inline const char* FrameCategoryName(FrameCategory category) {
+	switch (category) {
+		case FrameCategory::C: return "c";
+		case FrameCategory::FFI: return "ffi";
+		case FrameCategory::MAIN: return "main";
+		default: return "lua";
+	}
+}
+
+inline FrameCategory FrameCategoryOf(std::string_view frame) {
+	if (frame.ends_with("([C])")) return FrameCategory::C;
+	if (frame.ends_with("([FFI])")) return FrameCategory::FFI;
+	if (frame.ends_with(":0)")) return FrameCategory::MAIN;
+	return FrameCategory::LUA;
+}
+
+/**
+ * @brief: 调用上下文树 (CCT), 每个节点是一条调用路径上的一个函数
+ *     节点只保存自身的量 (调用次数, 自身时间, 自身分配字节), 包含子调用的量由子树求和得到,
+ *     所以内存中的树与折叠栈文件可以无损互相转换
+ *     函数名在函数表中只保存一次, 节点用函数 ID 引用
+ *
+ *   折叠栈文件每行一个节点: "f1;f2;f3 <self_ns> [<calls> <alloc_bytes>]"
+ *   只有一列数字时就是 flamegraph.pl 使用的普通折叠栈, 可以直接用来生成火焰图
+ *   记录时扣除的钩子开销写在文件开头的注释行 "# hook_overhead_ns <ns>" 中
+ *   每个函数的单次调用延迟直方图写在注释行 "# latency\t<函数>\t<直方图>" 中, flamegraph.pl 会忽略这些行
+ */
+class CallTreeProfile {
+public:
+	static constexpr uint32_t Root = 0;
+	static constexpr uint32_t NoFunction = UINT32_MAX;
+
+	struct Node {
+		uint32_t function {NoFunction};
+		uint32_t parent {Root};
+		uint64_t calls {0};
+		uint64_t selfNs {0};
+		uint64_t selfAllocBytes {0};
+		std::unordered_map<uint32_t, uint32_t> children {};  /* 函数 ID -> 子节点 */
+	};
+
+	CallTreeProfile() {
+		nodes.emplace_back();
+	}
+
+	uint32_t InternFunction(std::string_view name) {
+		auto it = functionIndex.find(std::string(name));
+		if (it != functionIndex.end()) {
+			return it->second;
+		}
+		auto id = static_cast<uint32_t>(functions.size());
+		functions.emplace_back(name);
+		functionIndex.emplace(functions.back(), id);
+		return id;
+	}
+	const std::string& FunctionName(uint32_t function) const {
+		return functions[function];
+	}
+
+	/* 子节点总是在父节点之后创建, 下标从大到小遍历即为后序 */
+	uint32_t Child(uint32_t node, uint32_t function) {
+		auto it = nodes[node].children.find(function);
+		if (it != nodes[node].children.end()) {
+			return it->second;
+		}
+		auto child = static_cast<uint32_t>(nodes.size());
+		nodes[node].children.emplace(function, child);
+		Node created {};
+		created.function = function;
+		created.parent = node;
+		nodes.push_back(std::move(created));
+		return child;
+	}
+	void Add(uint32_t node, uint64_t calls, uint64_t selfNs, uint64_t selfAllocBytes) {
+		nodes[node].calls += calls;
+		nodes[node].selfNs += selfNs;
+		nodes[node].selfAllocBytes += selfAllocBytes;
+	}
+
+	using CategoryTimes = std::array<uint64_t, FrameCategoryCount>;
+
+	/* 整个 profile 的自身时间按帧类别汇总 */
+	CategoryTimes CategorySelfNs() const {
+		CategoryTimes times {};
+		for (size_t i = 1; i < nodes.size(); ++i) {
+			times[static_cast<size_t>(FrameCategoryOf(functions[nodes[i].function]))] += nodes[i].selfNs;
+		}
+		return times;
+	}
+	/* "lua:45.0%,c:50.0%,ffi:5.0%,main:0.0%" */
+	std::string CategorySplit() const {
+		const CategoryTimes times = CategorySelfNs();
+		uint64_t total = 0;
+		for (uint64_t ns : times) total += ns;
+		std::string split;
+		for (size_t c = 0; c < FrameCategoryCount; ++c) {
+			if (!split.empty()) split += ',';
+			split += std::format("{}:{:.1f}%", FrameCategoryName(static_cast<FrameCategory>(c)),
+				total == 0 ? 0.0 : static_cast<double>(times[c]) * 100.0 / static_cast<double>(total));
+		}
+		return split;
+	}
+
+	/**
+	 * @brief: 每个函数的包含时间按子树中各帧的类别拆分, 递归调用只计最外层 (与 FunctionTotals 一致)
+	 *     例如 Lua 函数的包含时间中有多少花在它调用的 C 函数 (math.sin) 或 FFI 调用上
+	 */
+	std::vector<CategoryTimes> CategoryInclusiveById() const {
+		std::vector<CategoryTimes> subtree(nodes.size(), CategoryTimes {});
+		for (size_t i = nodes.size(); i-- > 1;) {
+			subtree[i][static_cast<size_t>(FrameCategoryOf(functions[nodes[i].function]))] += nodes[i].selfNs;
+			for (size_t c = 0; c < FrameCategoryCount; ++c) {
+				subtree[nodes[i].parent][c] += subtree[i][c];
+			}
+		}
+		std::vector<CategoryTimes> totals(functions.size(), CategoryTimes {});
+		for (size_t i = 1; i < nodes.size(); ++i) {
+			if (HasAncestor(static_cast<uint32_t>(i), nodes[i].function)) {
+				continue;
+			}
+			for (size_t c = 0; c < FrameCategoryCount; ++c) {
+				totals[nodes[i].function][c] += subtree[i][c];
+			}
+		}
+		return totals;
+	}
+
+	/**
+	 * @brief: 打印整个运行的类别拆分, 以及按包含时间降序的每个函数的拆分 (us)
+	 * @param limit: 0 为全部
+	 */
+	void PrintCategories(std::ostream& out, size_t limit = 0) const {
+		const CategoryTimes self = CategorySelfNs();
+		uint64_t total = 0;
+		for (uint64_t ns : self) total += ns;
+		out << "self time by category:";
+		for (size_t c = 0; c < FrameCategoryCount; ++c) {
+			out << std::format("  {} {:.1f} us ({:.1f}%)", FrameCategoryName(static_cast<FrameCategory>(c)), self[c] / 1e3,
+				total == 0 ? 0.0 : static_cast<double>(self[c]) * 100.0 / static_cast<double>(total));
+		}
+		out << "\n";
+
+		const auto split = CategoryInclusiveById();
+		auto inclusive = [&](uint32_t id) {
+			uint64_t sum = 0;
+			for (uint64_t ns : split[id]) sum += ns;
+			return sum;
+		};
+		std::vector<uint32_t> order;
+		for (uint32_t id = 0; id < split.size(); ++id) {
+			if (inclusive(id) > 0) order.push_back(id);
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return inclusive(a) > inclusive(b);
+		});
+		if (limit > 0 && order.size() > limit) {
+			order.resize(limit);
+		}
+		out << std::format("{:>12} {:>12} {:>12} {:>12} {:>12}  {}\n",
+			"total_us", "lua_us", "c_us", "ffi_us", "main_us", "function");
+		for (uint32_t id : order) {
+			const auto& times = split[id];
+			out << std::format("{:>12.1f} {:>12.1f} {:>12.1f} {:>12.1f} {:>12.1f}  {}\n",
+				inclusive(id) / 1e3,
+				times[static_cast<size_t>(FrameCategory::LUA)] / 1e3, times[static_cast<size_t>(FrameCategory::C)] / 1e3,
+				times[static_cast<size_t>(FrameCategory::FFI)] / 1e3, times[static_cast<size_t>(FrameCategory::MAIN)] / 1e3,
+				functions[id]);
+		}
+	}
+
+	/* 单次调用的包含时间 (ns), 每个函数一个直方图, 递归调用的每一层都计一次 */
+	void RecordLatency(uint32_t function, uint64_t inclusiveNs) {
+		if (latencies.size() <= function) {
+			latencies.resize(functions.size());
+		}
+		latencies[function].Record(inclusiveNs);
+	}
+	void MergeLatency(uint32_t function, const LatencyHistogram& latency) {
+		if (latencies.size() <= function) {
+			latencies.resize(functions.size());
+		}
+		latencies[function].Merge(latency);
+	}
+	/* 没有记录时返回空指针 */
+	const LatencyHistogram* Latency(uint32_t function) const {
+		return function < latencies.size() && latencies[function].Count() > 0 ? &latencies[function] : nullptr;
+	}
+
+	/**
+	 * @brief: 按 p99 降序打印每个函数的延迟分位数 (us)
+	 * @param limit: 0 为全部
+	 */
+	void PrintLatency(std::ostream& out, size_t limit = 0) const {
+		std::vector<uint32_t> order;
+		for (uint32_t id = 0; id < latencies.size(); ++id) {
+			if (latencies[id].Count() > 0) order.push_back(id);
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return latencies[a].Percentile(0.99) > latencies[b].Percentile(0.99);
+		});
+		if (limit > 0 && order.size() > limit) {
+			order.resize(limit);
+		}
+		out << std::format("{:>10} {:>10} {:>10} {:>10} {:>10} {:>10}  {}\n",
+			"calls", "p50_us", "p90_us", "p99_us", "p99.9_us", "max_us", "function");
+		for (uint32_t id : order) {
+			const LatencyHistogram& latency = latencies[id];
+			out << std::format("{:>10} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}  {}\n",
+				latency.Count(), latency.Percentile(0.50) / 1e3, latency.Percentile(0.90) / 1e3,
+				latency.Percentile(0.99) / 1e3, latency.Percentile(0.999) / 1e3, latency.Max() / 1e3,
+				functions[id]);
+		}
+	}
+
+	/* 记录时从时间中扣除的钩子开销 (估计值), 用来判断数字的可信程度 */
+	void AddHookOverhead(uint64_t ns) {
+		hookOverheadNs += ns;
+	}
+	uint64_t HookOverheadNs() const {
+		return hookOverheadNs;
+	}
+	double HookOverheadPerCallNs() const {
+		uint64_t calls = 0;
+		for (const auto& node : nodes) {
+			calls += node.calls;
+		}
+		return calls == 0 ? 0.0 : static_cast<double>(hookOverheadNs) / static_cast<double>(calls);
+	}
+
+	const std::vector<Node>& Nodes() const {
+		return nodes;
+	}
+	bool Empty() const {
+		return nodes.size() == 1;
+	}
+	void Clear() {
+		*this = CallTreeProfile();
+	}
+
+	/**
+	 * @brief: 按函数名把 other 的树合并进来, 两棵树的函数 ID 可以不同
+	 *     先把 other 的函数 ID 映射到本树 (每个函数名只哈希一次), 之后每个节点只做一次整数键的子节点查找,
+	 *     代价与 other 的节点数和函数数成正比, 与记录时的事件数无关
+	 */
+	void Merge(const CallTreeProfile& other) {
+		std::vector<uint32_t> functionMap(other.functions.size());
+		for (uint32_t id = 0; id < other.functions.size(); ++id) {
+			functionMap[id] = InternFunction(other.functions[id]);
+		}
+		std::vector<uint32_t> mapped(other.nodes.size(), Root);
+		for (size_t i = 1; i < other.nodes.size(); ++i) {
+			const Node& node = other.nodes[i];
+			uint32_t target = Child(mapped[node.parent], functionMap[node.function]);
+			mapped[i] = target;
+			Add(target, node.calls, node.selfNs, node.selfAllocBytes);
+		}
+		hookOverheadNs += other.hookOverheadNs;
+		for (uint32_t id = 0; id < other.latencies.size(); ++id) {
+			if (other.latencies[id].Count() > 0) {
+				MergeLatency(functionMap[id], other.latencies[id]);
+			}
+		}
+	}
+
+	/* 根到节点的路径, 用 ';' 连接 */
+	std::string StackOf(uint32_t node) const {
+		std::vector<uint32_t> path;
+		for (; node != Root; node = nodes[node].parent) {
+			path.push_back(node);
+		}
+		std::string stack;
+		for (auto it = path.rbegin(); it != path.rend(); ++it) {
+			if (!stack.empty()) stack += ';';
+			stack += functions[nodes[*it].function];
+		}
+		return stack;
+	}
+
+	void WriteCollapsed(std::ostream& out) const {
+		if (hookOverheadNs > 0) {
+			out << std::format("{} {}\n", HookOverheadComment, hookOverheadNs);
+		}
+		for (uint32_t i = 1; i < nodes.size(); ++i) {
+			const Node& node = nodes[i];
+			if (node.calls == 0 && node.selfNs == 0 && node.selfAllocBytes == 0) {
+				continue;
+			}
+			out << std::format("{} {} {} {}\n", StackOf(i), node.selfNs, node.calls, node.selfAllocBytes);
+		}
+		for (uint32_t id = 0; id < latencies.size(); ++id) {
+			if (latencies[id].Count() > 0) {
+				out << std::format("{}\t{}\t{}\n", LatencyComment, functions[id], latencies[id].Serialize());
+			}
+		}
+	}
+	bool SaveCollapsed(const std::filesystem::path& path) const {
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			return false;
+		}
+		WriteCollapsed(out);
+		return static_cast<bool>(out);
+	}
+
+	/**
+	 * @brief: 读取折叠栈文件, 行尾的 1 到 3 个整数依次为自身时间, 调用次数, 分配字节
+	 *     帧名中可能有空格 (例如 "name (file.lua:12)"), 所以从行尾向前取数字
+	 */
+	static std::optional<CallTreeProfile> LoadCollapsed(const std::filesystem::path& path, std::string& error) {
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			error = std::format("open profile {} failed", path.string());
+			return std::nullopt;
+		}
+		CallTreeProfile profile;
+		std::string line;
+		size_t lineNo = 0;
+		while (std::getline(in, line)) {
+			++lineNo;
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (line.starts_with(HookOverheadComment)) {
+				std::string_view value = std::string_view(line).substr(HookOverheadComment.size());
+				while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+				std::from_chars(value.data(), value.data() + value.size(), profile.hookOverheadNs);
+				continue;
+			}
+			if (line.starts_with(LatencyComment)) {
+				std::string_view rest = std::string_view(line).substr(LatencyComment.size());
+				size_t nameBegin = rest.find('\t');
+				size_t nameEnd = nameBegin == std::string_view::npos ? nameBegin : rest.find('\t', nameBegin + 1);
+				std::optional<LatencyHistogram> latency;
+				if (nameEnd != std::string_view::npos) {
+					latency = LatencyHistogram::Deserialize(rest.substr(nameEnd + 1));
+				}
+				if (!latency) {
+					error = std::format("{}:{}: invalid latency histogram", path.string(), lineNo);
+					return std::nullopt;
+				}
+				profile.MergeLatency(profile.InternFunction(rest.substr(nameBegin + 1, nameEnd - nameBegin - 1)), *latency);
+				continue;
+			}
+			if (line.empty() || line.front() == '#') continue;
+
+			std::string_view rest(line);
+			uint64_t values[3] {};
+			size_t count = 0;
+			while (count < 3) {
+				size_t space = rest.find_last_of(' ');
+				if (space == std::string_view::npos) break;
+				std::string_view token = rest.substr(space + 1);
+				uint64_t value = 0;
+				auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+				if (token.empty() || ec != std::errc() || ptr != token.data() + token.size()) break;
+				values[count++] = value;
+				rest = rest.substr(0, space);
+			}
+			if (count == 0 || rest.empty()) {
+				error = std::format("{}:{}: expected '<stack> <self_ns> [<calls> <alloc_bytes>]'", path.string(), lineNo);
+				return std::nullopt;
+			}
+			std::reverse(values, values + count);
+
+			uint32_t node = Root;
+			size_t begin = 0;
+			while (begin <= rest.size()) {
+				size_t end = rest.find(';', begin);
+				if (end == std::string_view::npos) end = rest.size();
+				node = profile.Child(node, profile.InternFunction(rest.substr(begin, end - begin)));
+				begin = end + 1;
+			}
+			profile.Add(node, count > 1 ? values[1] : 0, values[0], count > 2 ? values[2] : 0);
+		}
+		return profile;
+	}
+
+	/* 按函数汇总, 递归调用的包含时间只在最外层计一次 */
+	struct FunctionTotals {
+		uint64_t calls {0};
+		uint64_t selfNs {0};
+		uint64_t inclusiveNs {0};
+		uint64_t selfAllocBytes {0};
+		uint64_t inclusiveAllocBytes {0};
+	};
+	std::vector<FunctionTotals> FunctionTotalsById() const {
+		std::vector<uint64_t> inclusiveNs(nodes.size(), 0);
+		std::vector<uint64_t> inclusiveAlloc(nodes.size(), 0);
+		for (size_t i = nodes.size(); i-- > 1;) {
+			inclusiveNs[i] += nodes[i].selfNs;
+			inclusiveAlloc[i] += nodes[i].selfAllocBytes;
+			inclusiveNs[nodes[i].parent] += inclusiveNs[i];
+			inclusiveAlloc[nodes[i].parent] += inclusiveAlloc[i];
+		}
+		std::vector<FunctionTotals> totals(functions.size());
+		for (size_t i = 1; i < nodes.size(); ++i) {
+			const Node& node = nodes[i];
+			FunctionTotals& total = totals[node.function];
+			total.calls += node.calls;
+			total.selfNs += node.selfNs;
+			total.selfAllocBytes += node.selfAllocBytes;
+			if (!HasAncestor(static_cast<uint32_t>(i), node.function)) {
+				total.inclusiveNs += inclusiveNs[i];
+				total.inclusiveAllocBytes += inclusiveAlloc[i];
+			}
+		}
+		return totals;
+	}
+
+private:
+	bool HasAncestor(uint32_t node, uint32_t function) const {
+		for (node = nodes[node].parent; node != Root; node = nodes[node].parent) {
+			if (nodes[node].function == function) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	static constexpr std::string_view HookOverheadComment = "# hook_overhead_ns";
+	static constexpr std::string_view LatencyComment = "# latency";
+
+	std::vector<Node> nodes {};
+	std::vector<std::string> functions {};
+	std::unordered_map<std::string, uint32_t> functionIndex {};
+	uint64_t hookOverheadNs {0};
+	std::vector<LatencyHistogram> latencies {};  /* 按函数 ID, 第一次记录时扩展 */
+};
+
+/**
+ * @brief: 汇总多个虚拟机/线程的调用树 (包括每个函数的延迟直方图与扣除的钩子开销)
+ *     每个 LuaVM 的报告器只由正在运行它的线程写入, 钩子路径上没有共享状态与锁;
+ *     运行结束后各线程把自己的树提交到这里, 只有提交时加锁
+ *     第一份提交直接接管, 之后的提交按节点合并 (见 CallTreeProfile::Merge)
+ */
+class ProfileAggregator {
+public:
+	void Submit(std::unique_ptr<CallTreeProfile> profile) {
+		if (!profile) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		++submissions;
+		if (!merged) {
+			merged = std::move(profile);
+		} else {
+			merged->Merge(*profile);
+		}
+	}
+	void Submit(const CallTreeProfile& profile) {
+		std::lock_guard<std::mutex> lock(mutex);
+		++submissions;
+		if (!merged) {
+			merged = std::make_unique<CallTreeProfile>(profile);
+		} else {
+			merged->Merge(profile);
+		}
+	}
+
+	size_t Submissions() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return submissions;
+	}
+
+	/* 取出合并结果并清空, 没有提交时返回空树 */
+	CallTreeProfile Take() {
+		std::lock_guard<std::mutex> lock(mutex);
+		CallTreeProfile result = merged ? std::move(*merged) : CallTreeProfile();
+		merged.reset();
+		submissions = 0;
+		return result;
+	}
+
+private:
+	mutable std::mutex mutex {};
+	std::unique_ptr<CallTreeProfile> merged {nullptr};
+	size_t submissions {0};
+};
+
+/**
+ * @brief: 两份调用树的差异, 函数按源码位置对齐
+ *     帧名形如 "name (file.lua:12)" 时以 "file.lua:12" 为键: 同一个函数在不同调用点
+ *     得到的名字可能不同 (local/字段名/unknown), 按位置对齐才不会拆成多行
+ */
+struct ProfileDiffRow {
+	std::string name;
+	CallTreeProfile::FunctionTotals before {};
+	CallTreeProfile::FunctionTotals after {};
+
+	static int64_t Delta(uint64_t before, uint64_t after) {
+		return static_cast<int64_t>(after) - static_cast<int64_t>(before);
+	}
+};
+
+enum class ProfileDiffSort {
+	SELF,
+	INCLUSIVE,
+	CALLS,
+	ALLOC
+};
+
+/*
+ * 对比时函数的键: Lua 函数取定义位置 "file:line" (改名不影响对应关系),
+ * C 函数 "name ([C])" 与 FFI 调用 "name ([FFI])" 没有位置, 取整个帧名
+ */
+inline std::string_view ProfileFunctionLocation(std::string_view frame) {
+	if (!frame.empty() && frame.back() == ')') {
+		size_t open = frame.rfind(" (");
+		if (open != std::string_view::npos) {
+			std::string_view location = frame.substr(open + 2, frame.size() - open - 3);
+			if (location.find(':') != std::string_view::npos) {
+				return location;
+			}
+		}
+	}
+	return frame;
+}
+
+class ProfileDiff {
+public:
+	/* 两份 profile 会被复制, 之后可以随意修改或释放原对象 */
+	ProfileDiff(CallTreeProfile before, CallTreeProfile after)
+		: beforeProfile(std::move(before)), afterProfile(std::move(after)) {
+		Collect(beforeProfile, true);
+		Collect(afterProfile, false);
+	}
+
+	uint64_t TotalBeforeNs() const {
+		return totalNs[0];
+	}
+	uint64_t TotalAfterNs() const {
+		return totalNs[1];
+	}
+
+	/* 按变化量的绝对值降序; 自身时间的变化之和等于总时间的变化, 是默认的排序依据 */
+	std::vector<ProfileDiffRow> Rows(ProfileDiffSort sort = ProfileDiffSort::SELF) const {
+		std::vector<ProfileDiffRow> sorted = rows;
+		auto impact = [sort](const ProfileDiffRow& row) -> uint64_t {
+			int64_t delta = 0;
+			switch (sort) {
+				case ProfileDiffSort::SELF: delta = ProfileDiffRow::Delta(row.before.selfNs, row.after.selfNs); break;
+				case ProfileDiffSort::INCLUSIVE: delta = ProfileDiffRow::Delta(row.before.inclusiveNs, row.after.inclusiveNs); break;
+				case ProfileDiffSort::CALLS: delta = ProfileDiffRow::Delta(row.before.calls, row.after.calls); break;
+				case ProfileDiffSort::ALLOC: delta = ProfileDiffRow::Delta(row.before.inclusiveAllocBytes, row.after.inclusiveAllocBytes); break;
+			}
+			return static_cast<uint64_t>(std::llabs(delta));
+		};
+		std::stable_sort(sorted.begin(), sorted.end(), [&](const auto& a, const auto& b) {
+			return impact(a) > impact(b);
+		});
+		return sorted;
+	}
+
+	void Print(std::ostream& out, size_t limit = 0, ProfileDiffSort sort = ProfileDiffSort::SELF) const {
+		auto delta = [](uint64_t before, uint64_t after) {
+			return ProfileDiffRow::Delta(before, after);
+		};
+		auto percent = [](uint64_t before, uint64_t after) -> std::string {
+			if (before == 0) return after == 0 ? "0%" : "new";
+			return std::format("{:+.1f}%", (static_cast<double>(after) - static_cast<double>(before)) * 100.0 / static_cast<double>(before));
+		};
+		out << std::format("total self: {:.1f} us -> {:.1f} us ({})\n",
+			totalNs[0] / 1e3, totalNs[1] / 1e3, percent(totalNs[0], totalNs[1]));
+		out << std::format("self by category: {} -> {}\n", beforeProfile.CategorySplit(), afterProfile.CategorySplit());
+		if (beforeProfile.HookOverheadNs() > 0 || afterProfile.HookOverheadNs() > 0) {
+			out << std::format("hook overhead subtracted: {:.0f} ns/call ({:.1f} us) -> {:.0f} ns/call ({:.1f} us)\n",
+				beforeProfile.HookOverheadPerCallNs(), beforeProfile.HookOverheadNs() / 1e3,
+				afterProfile.HookOverheadPerCallNs(), afterProfile.HookOverheadNs() / 1e3);
+		}
+		out << std::format("{:>12} {:>8} {:>12} {:>8} {:>10} {:>12}  {}\n",
+			"d_self_us", "self", "d_total_us", "total", "d_calls", "d_alloc_KB", "function");
+		const auto sorted = Rows(sort);
+		const size_t count = limit == 0 ? sorted.size() : std::min(limit, sorted.size());
+		for (size_t i = 0; i < count; ++i) {
+			const auto& row = sorted[i];
+			out << std::format("{:>+12.1f} {:>8} {:>+12.1f} {:>8} {:>+10} {:>+12.1f}  {}\n",
+				delta(row.before.selfNs, row.after.selfNs) / 1e3, percent(row.before.selfNs, row.after.selfNs),
+				delta(row.before.inclusiveNs, row.after.inclusiveNs) / 1e3, percent(row.before.inclusiveNs, row.after.inclusiveNs),
+				delta(row.before.calls, row.after.calls),
+				delta(row.before.inclusiveAllocBytes, row.after.inclusiveAllocBytes) / 1024.0,
+				row.name);
+		}
+	}
+
+	/**
+	 * @brief: 差分火焰图的输入: 每行 "stack <before_ns> <after_ns>"
+	 *     与 difffolded.pl 的输出格式相同, flamegraph.pl 会按两列的差值着色 (红色变慢, 蓝色变快)
+	 *     帧名按源码位置统一成同一个显示名, 两份 profile 的栈才能对齐
+	 */
+	void WriteDiffCollapsed(std::ostream& out) const {
+		std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> stacks;
+		std::vector<std::string> order;
+		auto collect = [&](const CallTreeProfile& profile, bool bAfter) {
+			const auto& nodes = profile.Nodes();
+			for (uint32_t i = 1; i < nodes.size(); ++i) {
+				if (nodes[i].selfNs == 0) continue;
+				std::vector<uint32_t> path;
+				for (uint32_t node = i; node != CallTreeProfile::Root; node = nodes[node].parent) {
+					path.push_back(node);
+				}
+				std::string stack;
+				for (auto it = path.rbegin(); it != path.rend(); ++it) {
+					if (!stack.empty()) stack += ';';
+					stack += DisplayName(profile.FunctionName(nodes[*it].function));
+				}
+				auto [entry, bInserted] = stacks.try_emplace(stack, 0, 0);
+				if (bInserted) order.push_back(stack);
+				(bAfter ? entry->second.second : entry->second.first) += nodes[i].selfNs;
+			}
+		};
+		collect(beforeProfile, false);
+		collect(afterProfile, true);
+		for (const auto& stack : order) {
+			const auto& [before, after] = stacks[stack];
+			out << std::format("{} {} {}\n", stack, before, after);
+		}
+	}
+	bool SaveDiffCollapsed(const std::filesystem::path& path) const {
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			return false;
+		}
+		WriteDiffCollapsed(out);
+		return static_cast<bool>(out);
+	}
+
+private:
+	void Collect(const CallTreeProfile& profile, bool bBefore) {
+		for (const auto& node : profile.Nodes()) {
+			totalNs[bBefore ? 0 : 1] += node.selfNs;
+		}
+		const auto totals = profile.FunctionTotalsById();
+		for (uint32_t id = 0; id < totals.size(); ++id) {
+			const std::string& name = profile.FunctionName(id);
+			std::string location(ProfileFunctionLocation(name));
+			auto [it, bInserted] = rowIndex.try_emplace(location, rows.size());
+			if (bInserted) {
+				rows.push_back({name});
+			} else if (IsUnknownName(rows[it->second].name) || (!bBefore && !IsUnknownName(name))) {
+				/* 优先显示新 profile 中的名字, 但不用 unknown 覆盖已知的名字 */
+				rows[it->second].name = name;
+			}
+			displayNames[location] = rows[it->second].name;
+			Accumulate(bBefore ? rows[it->second].before : rows[it->second].after, totals[id]);
+		}
+	}
+	static bool IsUnknownName(std::string_view name) {
+		return name.starts_with("unknown");
+	}
+	static void Accumulate(CallTreeProfile::FunctionTotals& into, const CallTreeProfile::FunctionTotals& from) {
+		into.calls += from.calls;
+		into.selfNs += from.selfNs;
+		into.inclusiveNs += from.inclusiveNs;
+		into.selfAllocBytes += from.selfAllocBytes;
+		into.inclusiveAllocBytes += from.inclusiveAllocBytes;
+	}
+	const std::string& DisplayName(const std::string& frame) const {
+		auto it = displayNames.find(std::string(ProfileFunctionLocation(frame)));
+		return it != displayNames.end() ? it->second : frame;
+	}
+
+private:
+	CallTreeProfile beforeProfile {};
+	CallTreeProfile afterProfile {};
+	std::vector<ProfileDiffRow> rows {};
+	std::unordered_map<std::string, size_t> rowIndex {};
+	std::unordered_map<std::string, std::string> displayNames {};
+	uint64_t totalNs[2] {0, 0};
+};
+
+} // namespace LuaBenchmark
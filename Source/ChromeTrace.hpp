@@ -0,0 +1,176 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: 当前系统线程的标识, 用作时间线中的 pid (每个系统线程一个分组)
+ */
+inline static uint64_t CurrentTraceThreadId() {
+#ifdef __linux__
+	return static_cast<uint64_t>(syscall(SYS_gettid));
+#else
+	return static_cast<uint64_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()) & 0x7fffffff);
+#endif
+}
+
+/**
+ * @brief: 流式写出 Chrome Trace Event 格式 (JSON) 的时间线
+ *     Perfetto UI (ui.perfetto.dev, 可离线使用) 与 chrome://tracing 都能直接打开
+ *     - 每个 pid 是一个进程分组 (本项目中对应一个系统线程), 每个 tid 是一条轨道 (对应一个 Lua 线程/协程)
+ *     - Begin/End 成对组成一个切片, 同一轨道上按栈嵌套
+ *     - Counter 生成计数器轨道 (例如 Lua 堆大小)
+ *     事件先拼在内存缓冲区中, 超过 64KB 才写文件; Close (或析构) 时补全 JSON 结尾
+ */
+class ChromeTraceWriter {
+public:
+	ChromeTraceWriter() = default;
+	~ChromeTraceWriter() {
+		Close();
+	}
+	ChromeTraceWriter(const ChromeTraceWriter&) = delete;
+	ChromeTraceWriter& operator=(const ChromeTraceWriter&) = delete;
+
+	bool Open(const std::filesystem::path& path) {
+		Close();
+		file = std::fopen(path.string().c_str(), "wb");
+		if (!file) {
+			errorMessage = std::format("Open chrome trace failed: {}", path.string());
+			return false;
+		}
+		buffer.clear();
+		buffer.reserve(FlushBytes + 4096);
+		buffer += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+		bFirstEvent = true;
+		return true;
+	}
+
+	void Close() {
+		if (!file) {
+			return;
+		}
+		buffer += "\n]}\n";
+		Flush();
+		std::fclose(file);
+		file = nullptr;
+	}
+
+	bool IsOpen() const {
+		return file != nullptr;
+	}
+	const std::string& ErrorMessage() const {
+		return errorMessage;
+	}
+
+	/* 进程/轨道的显示名, sortIndex 决定轨道在界面中的顺序 */
+	void ProcessName(uint64_t pid, std::string_view name) {
+		BeginEvent();
+		buffer += std::format("{{\"ph\":\"M\",\"pid\":{},\"name\":\"process_name\",\"args\":{{\"name\":\"", pid);
+		AppendEscaped(name);
+		buffer += "\"}}";
+		EndEvent();
+	}
+	void ThreadName(uint64_t pid, uint64_t tid, std::string_view name, int64_t sortIndex = 0) {
+		BeginEvent();
+		buffer += std::format("{{\"ph\":\"M\",\"pid\":{},\"tid\":{},\"name\":\"thread_name\",\"args\":{{\"name\":\"", pid, tid);
+		AppendEscaped(name);
+		buffer += "\"}}";
+		EndEvent();
+		BeginEvent();
+		buffer += std::format("{{\"ph\":\"M\",\"pid\":{},\"tid\":{},\"name\":\"thread_sort_index\",\"args\":{{\"sort_index\":{}}}}}",
+			pid, tid, sortIndex);
+		EndEvent();
+	}
+
+	/* 时间戳单位为纳秒, 写出时转换为 Trace Event 要求的微秒 (保留小数) */
+	void Begin(uint64_t pid, uint64_t tid, uint64_t timestampNs, std::string_view name, std::string_view category = "lua") {
+		BeginEvent();
+		buffer += std::format("{{\"ph\":\"B\",\"pid\":{},\"tid\":{},\"ts\":{}.{:03},\"cat\":\"",
+			pid, tid, timestampNs / 1000, timestampNs % 1000);
+		AppendEscaped(category);
+		buffer += "\",\"name\":\"";
+		AppendEscaped(name);
+		buffer += "\"}";
+		EndEvent();
+	}
+	void End(uint64_t pid, uint64_t tid, uint64_t timestampNs) {
+		BeginEvent();
+		buffer += std::format("{{\"ph\":\"E\",\"pid\":{},\"tid\":{},\"ts\":{}.{:03}}}",
+			pid, tid, timestampNs / 1000, timestampNs % 1000);
+		EndEvent();
+	}
+	void Instant(uint64_t pid, uint64_t tid, uint64_t timestampNs, std::string_view name) {
+		BeginEvent();
+		buffer += std::format("{{\"ph\":\"i\",\"s\":\"t\",\"pid\":{},\"tid\":{},\"ts\":{}.{:03},\"name\":\"",
+			pid, tid, timestampNs / 1000, timestampNs % 1000);
+		AppendEscaped(name);
+		buffer += "\"}";
+		EndEvent();
+	}
+	void Counter(uint64_t pid, uint64_t timestampNs, std::string_view name, std::string_view series, double value) {
+		BeginEvent();
+		buffer += std::format("{{\"ph\":\"C\",\"pid\":{},\"ts\":{}.{:03},\"name\":\"",
+			pid, timestampNs / 1000, timestampNs % 1000);
+		AppendEscaped(name);
+		buffer += "\",\"args\":{\"";
+		AppendEscaped(series);
+		buffer += std::format("\":{}}}}}", value);
+		EndEvent();
+	}
+
+private:
+	static constexpr size_t FlushBytes = 64 * 1024;
+
+	void BeginEvent() {
+		if (!bFirstEvent) {
+			buffer += ",\n";
+		}
+		bFirstEvent = false;
+	}
+	void EndEvent() {
+		if (buffer.size() >= FlushBytes) {
+			Flush();
+		}
+	}
+	void Flush() {
+		if (file && !buffer.empty()) {
+			std::fwrite(buffer.data(), 1, buffer.size(), file);
+		}
+		buffer.clear();
+	}
+	void AppendEscaped(std::string_view str) {
+		for (char c : str) {
+			switch (c) {
+				case '"': buffer += "\\\""; break;
+				case '\\': buffer += "\\\\"; break;
+				case '\n': buffer += "\\n"; break;
+				case '\t': buffer += "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						buffer += std::format("\\u{:04x}", static_cast<unsigned char>(c));
+					} else {
+						buffer += c;
+					}
+			}
+		}
+	}
+
+private:
+	std::FILE* file {nullptr};
+	std::string buffer {};
+	bool bFirstEvent {true};
+	std::string errorMessage {""};
+};
+
+} // namespace LuaBenchmark
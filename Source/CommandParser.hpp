@@ -9,6 +9,8 @@
 #include <vector>
 #include "lua.hpp" // LuaJIT 头文件
 #include "LuaVM.hpp"
+#include "Runner.hpp"
+#include "WatchSession.hpp"
 #include "Tools.hpp"
 
 #ifdef _WIN32
@@ -16,8 +18,12 @@
 #include <windows.h>
 #endif
 
-void CheckCommandNum(const std::vector<std::string>& args, int expected) {
-    if (args.size() != expected) {
+/* 基准测试入口, 定义在 old_main.cpp */
+int old_main(int argc, char** argv);
+
+/* args 包含程序名与命令本身, expected 只计命令之后的参数 */
+void CheckCommandNum(const std::vector<std::string>& args, size_t expected) {
+    if (args.size() != expected + 2) {
         std::string info = "";
         if (expected == 0){
             info = std::format("{} 不接受参数, 请使用 --help 查看帮助信息", args[1]);
@@ -72,16 +78,233 @@ void CommandParser(const std::vector<std::string>& args){
         CheckCommandNum(args, 0);
         // 显示版本信息
         std::cout << "Version Say Hello\n";
-    } else if (args[1] == "--list") {
-        CheckCommandNum(args, 0);
-        // 列出所有Lua虚拟机
-        std::cout << "List Say Hello\n";
-    } else if (args[1] == "--create") {
-        // 创建Lua执行环境
-    } else if (args[1] == "--destroy") {
-        // 销毁Lua执行环境
-    } else if (args[1] == "--run") {
-        // 运行Lua脚本
+    } else if (args[1] == "--serve") {
+        // 启动常驻的 Runner: 有 -S 时监听 Unix 域套接字, 否则从 stdin 读取命令
+        Command cmd = ParseCommand(args);
+        auto& runner = LuaBenchmark::Runner::Instance();
+        if (auto it = cmd.argMap.find("-S"); it != cmd.argMap.end()) {
+            runner.ServeUnixSocket(it->second.empty() ? LuaBenchmark::RunnerDefaultSocket : it->second[0]);
+        } else {
+            runner.ServeStream(std::cin, std::cout);
+        }
+    } else if (args[1] == "--create" || args[1] == "--destroy" || args[1] == "--list" || args[1] == "--run") {
+        // 发送给常驻的 Runner, 复用已经创建的虚拟机
+        Command cmd = ParseCommand(args);
+        auto option = [&](const std::string& key) -> std::string {
+            auto it = cmd.argMap.find(key);
+            if (it == cmd.argMap.end() || it->second.empty()) {
+                return "";
+            }
+            std::string value = it->second[0];
+            for (size_t i = 1; i < it->second.size(); ++i) {
+                value += " " + it->second[i];
+            }
+            return value;
+        };
+        std::string request;
+        if (args[1] == "--create") {
+            request = std::format("create {} {} {}", option("-m"), option("-w"), option("-s"));
+            if (auto libs = option("-l"); !libs.empty()) {
+                request += " -l " + libs;
+            }
+            if (auto metrics = option("-L"); !metrics.empty()) {
+                request += " -L " + metrics;
+            }
+        } else if (args[1] == "--destroy") {
+            request = std::format("destroy {}", option("-m"));
+        } else if (args[1] == "--list") {
+            request = "list";
+        } else {
+            if (cmd.args.empty()) {
+                throw std::invalid_argument("--run 需要虚拟机名称, 请使用 --help 查看帮助信息");
+            }
+            request = std::format("run {}", cmd.args[0]);
+            if (auto repeat = option("-r"); !repeat.empty()) {
+                request += " -r " + repeat;
+            }
+            if (auto workers = option("-j"); !workers.empty()) {
+                request += " -j " + workers;
+            }
+            for (const char* key : {"-I", "-M", "-T"}) {
+                if (auto value = option(key); !value.empty()) {
+                    request += std::format(" {} {}", key, value);
+                }
+            }
+            if (auto profile = option("-p"); !profile.empty()) {
+                request += " -p " + std::filesystem::absolute(profile).string();
+            }
+            if (auto trace = option("-t"); !trace.empty()) {
+                request += " -t " + std::filesystem::absolute(trace).string();
+            }
+            if (auto chrome = option("-C"); !chrome.empty()) {
+                request += " -C " + std::filesystem::absolute(chrome).string();
+            }
+            if (auto filter = option("-f"); !filter.empty()) {
+                request += " -f " + filter;
+            }
+            if (cmd.argMap.contains("-R")) {
+                request += " -R";
+            }
+            if (auto file = option("-af"); !file.empty()) {
+                // Runner 可能在别的工作目录, 发送绝对路径
+                request += " -af " + std::filesystem::absolute(file).string();
+            } else if (cmd.argMap.contains("-a")) {
+                request += " -a " + option("-a");
+            }
+        }
+        std::string socketPath = option("-S").empty() ? LuaBenchmark::RunnerDefaultSocket : option("-S");
+        auto replies = LuaBenchmark::Runner::Send(socketPath, {request});
+        if (!replies.has_value() || replies->empty()) {
+            throw std::runtime_error(std::format("无法连接到 Runner ({}), 请先运行 --serve -S", socketPath));
+        }
+        std::cout << replies->front() << "\n";
+    } else if (args[1] == "--batch") {
+        // 流水线: 从 stdin 读取全部命令, 一次发送, 按顺序打印回复
+        Command cmd = ParseCommand(args);
+        std::string socketPath = LuaBenchmark::RunnerDefaultSocket;
+        if (auto it = cmd.argMap.find("-S"); it != cmd.argMap.end() && !it->second.empty()) {
+            socketPath = it->second[0];
+        }
+        std::vector<std::string> commands;
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (!line.empty()) {
+                commands.push_back(line);
+            }
+        }
+        auto replies = LuaBenchmark::Runner::Send(socketPath, commands);
+        if (!replies.has_value()) {
+            throw std::runtime_error(std::format("无法连接到 Runner ({}), 请先运行 --serve -S", socketPath));
+        }
+        for (const auto& reply : replies.value()) {
+            std::cout << reply << "\n";
+        }
+    } else if (args[1] == "--diff") {
+        // 比较两份折叠栈 profile: --diff <before> <after> [-n <行数>] [-k self|total|calls|alloc] [-o <差分折叠栈>]
+        Command cmd = ParseCommand(args);
+        if (cmd.args.size() != 2) {
+            throw std::invalid_argument("--diff 需要两个 profile 文件, 请使用 --help 查看帮助信息");
+        }
+        auto option = [&](const std::string& key) -> std::string {
+            auto it = cmd.argMap.find(key);
+            return it == cmd.argMap.end() || it->second.empty() ? "" : it->second[0];
+        };
+        std::string error;
+        auto before = LuaBenchmark::CallTreeProfile::LoadCollapsed(cmd.args[0], error);
+        if (!before.has_value()) {
+            throw std::runtime_error(error);
+        }
+        auto after = LuaBenchmark::CallTreeProfile::LoadCollapsed(cmd.args[1], error);
+        if (!after.has_value()) {
+            throw std::runtime_error(error);
+        }
+        static const std::unordered_map<std::string, LuaBenchmark::ProfileDiffSort> sortKeys = {
+            {"self", LuaBenchmark::ProfileDiffSort::SELF},
+            {"total", LuaBenchmark::ProfileDiffSort::INCLUSIVE},
+            {"calls", LuaBenchmark::ProfileDiffSort::CALLS},
+            {"alloc", LuaBenchmark::ProfileDiffSort::ALLOC},
+        };
+        auto sort = LuaBenchmark::ProfileDiffSort::SELF;
+        if (auto key = option("-k"); !key.empty()) {
+            auto it = sortKeys.find(key);
+            if (it == sortKeys.end()) {
+                throw std::invalid_argument(std::format("未知的排序方式: {}", key));
+            }
+            sort = it->second;
+        }
+        size_t limit = option("-n").empty() ? 30 : std::stoull(option("-n"));
+        LuaBenchmark::ProfileDiff diff(std::move(before.value()), std::move(after.value()));
+        diff.Print(std::cout, limit, sort);
+        if (auto output = option("-o"); !output.empty()) {
+            if (!diff.SaveDiffCollapsed(output)) {
+                throw std::runtime_error(std::format("写入 {} 失败", output));
+            }
+            std::cout << std::format("differential folded stacks: {} (flamegraph.pl {} > diff.svg)\n", output, output);
+        }
+    } else if (args[1] == "--latency" || args[1] == "--split") {
+        // 延迟分位数: --latency <profile...> [-n <行数>] [-o <合并后的 profile>], 多个文件的直方图按函数名合并
+        // 时间拆分: --split <profile...> [-n <行数>], 按 Lua / C / FFI / main 拆分整个运行与每个函数的时间
+        Command cmd = ParseCommand(args);
+        if (cmd.args.empty()) {
+            throw std::invalid_argument(std::format("{} 需要至少一个 profile 文件, 请使用 --help 查看帮助信息", args[1]));
+        }
+        auto option = [&](const std::string& key) -> std::string {
+            auto it = cmd.argMap.find(key);
+            return it == cmd.argMap.end() || it->second.empty() ? "" : it->second[0];
+        };
+        LuaBenchmark::CallTreeProfile merged;
+        for (const auto& path : cmd.args) {
+            std::string error;
+            auto profile = LuaBenchmark::CallTreeProfile::LoadCollapsed(path, error);
+            if (!profile.has_value()) {
+                throw std::runtime_error(error);
+            }
+            merged.Merge(profile.value());
+        }
+        size_t limit = option("-n").empty() ? 30 : std::stoull(option("-n"));
+        if (args[1] == "--split") {
+            merged.PrintCategories(std::cout, limit);
+        } else {
+            merged.PrintLatency(std::cout, limit);
+        }
+        if (auto output = option("-o"); !output.empty()) {
+            if (!merged.SaveCollapsed(output)) {
+                throw std::runtime_error(std::format("写入 {} 失败", output));
+            }
+            std::cout << std::format("merged profile: {}\n", output);
+        }
+    } else if (args[1] == "--watch") {
+        // 监视模式: 修改工作空间中的文件后热重载并重新测量
+        Command cmd = ParseCommand(args);
+        auto option = [&](const std::string& key) -> std::string {
+            auto it = cmd.argMap.find(key);
+            if (it == cmd.argMap.end() || it->second.empty()) {
+                return "";
+            }
+            std::string value = it->second[0];
+            for (size_t i = 1; i < it->second.size(); ++i) {
+                value += " " + it->second[i];
+            }
+            return value;
+        };
+        if (option("-w").empty() || option("-s").empty()) {
+            throw std::invalid_argument("--watch 需要 -w <workspace> 与 -s <module::function>, 请使用 --help 查看帮助信息");
+        }
+        LuaBenchmark::WatchSessionOptions options;
+        options.args = option("-a");
+        if (auto repeat = option("-r"); !repeat.empty()) {
+            options.repeat = std::max<uint64_t>(1, std::stoull(repeat));
+        }
+        if (auto iterations = option("-n"); !iterations.empty()) {
+            options.maxIterations = std::stoull(iterations);
+        }
+        if (auto rows = option("-p"); !rows.empty()) {
+            options.profileRows = std::stoull(rows);
+        }
+        LuaBenchmark::RunWatchSession(option("-w"), option("-s"), options, std::cout);
+    } else if (args[1] == "--top") {
+        // 查看实时指标: --top <name> [-i <刷新间隔 ms>] [-n <刷新次数>]
+        Command cmd = ParseCommand(args);
+        if (cmd.args.size() != 1) {
+            throw std::invalid_argument("--top 需要一个指标名称, 请使用 --help 查看帮助信息");
+        }
+        auto interval = std::chrono::milliseconds(500);
+        uint64_t count = 0;
+        if (auto it = cmd.argMap.find("-i"); it != cmd.argMap.end() && !it->second.empty()) {
+            interval = std::chrono::milliseconds(std::stoll(it->second[0]));
+        }
+        if (auto it = cmd.argMap.find("-n"); it != cmd.argMap.end() && !it->second.empty()) {
+            count = std::stoull(it->second[0]);
+        }
+        LuaBenchmark::RunLiveMetricsViewer(cmd.args[0], interval, count);
+    } else if (args[1] == "--bench") {
+        // 运行基准测试, 其余参数交给 old_main
+        std::vector<char*> benchArgv;
+        benchArgv.push_back(const_cast<char*>(args[0].c_str()));
+        for (size_t i = 2; i < args.size(); ++i) {
+            benchArgv.push_back(const_cast<char*>(args[i].c_str()));
+        }
+        old_main(static_cast<int>(benchArgv.size()), benchArgv.data());
     } else {
         std::cout << "Unknown command: " << args[1] << std::endl;
     }
@@ -98,19 +321,67 @@ int entry(int argc, char** argv) {
 /*
  * --help: 显示帮助信息并退出
  * --version: 显示版本信息并退出
+ * --serve: 启动常驻的 Runner, 托管命名的lua虚拟机
+ *    -S [path]: 监听 Unix 域套接字 (默认 /tmp/luaprofile.sock), 不指定时从 stdin 读取命令
  * --list: 列出当前所有注册的Lua虚拟机
  * --create: 创建一个lua执行环境
  *    -m <name>: 指定lua虚拟机名称
  *    -w <path>: 指定lua工作目录(根目录)
- *    -s <script>: 指定lua脚本文件
+ *    -s <module::function>: 指定lua入口模块与函数
+ *    -l <libs>: 打开的标准库, 逗号分隔 (base,package,table,io,os,string,math,debug,bit,jit,ffi), 默认 all
+ *    -L <name>: 发布每次运行的耗时, 堆, GC 与热点函数, 用 --top <name> 查看 (开启后运行都带调用钩子)
  *    -p <path>: 指定检测报告输出路径
  * --destroy: 销毁一个lua执行环境
  *    -m <name>: 指定lua虚拟机名称
  * --run: 运行Lua脚本
  *    <name>: 指定lua虚拟机名称
  *    -a  <args>: 传递给Lua脚本的参数
- *    -af <file>: 指定文件作为参数传递给Lua脚本
+ *    -af <file>: 指定文件作为参数传递给Lua脚本 (mmap 映射, 不拷贝; 入口函数收到 input 对象:
+ *                input:ptr()/#input 配合 ffi.cast("const uint8_t*", ...), 或 input:chunks(n)/input:views(n) 迭代)
  *    -r <num>: 指定脚本运行次数，默认1次
+ *    -j <num>: 并行线程数, 每个线程使用自己的虚拟机副本, 结果合并为一个延迟分布
+ *    -I <num>: 每次运行的指令预算, -M <MB>: Lua 堆上限, -T <ms>: 每次运行的截止时间
+ *              (超出时运行被中止, 错误信息以 aborted(instructions|memory|deadline) 开头)
+ *              (-M 也计入还没有回收的垃圾, 分配失败前不会先回收, 需要比存活数据多留出余量;
+ *               memory 的错误信息中 live_after_gc 是完整回收后的堆大小)
+ *    -p <file>: 记录调用上下文树, 保存为折叠栈 (每行: 栈 自身ns 调用次数 分配字节)
+ *               时间已扣除开始时标定的钩子开销, 扣除的总量写在文件开头的注释行, 回复中给出每次调用的开销
+ *    -t <file>: 把调用/返回事件写成二进制 trace, 用 LuaTraceDecoder 转换 (多线程时其余线程写 <file>.w<i>)
+ *    -C <file>: 把调用/返回写成 Chrome Trace Event JSON, 用 Perfetto UI 打开 (多线程时文件名同 -t)
+ *    -f <rules>: 插桩过滤, 逗号分隔的 [+|-](module|file|func):<glob>, 例如 +module:mod1,-func:helper*
+ *                (被过滤的函数不记录, 时间计入调用者)
+ *    -R: 只记录脚本中 luaprofile.start()/stop() 或 luaprofile.region(fn, ...) 之间的调用,
+ *        区域之外不安装调用钩子, 以完整的 JIT 速度运行
+ *    (--list/--create/--destroy/--run 都发送给 Runner, -S <path> 指定套接字)
+ * --batch: 从 stdin 读取多条 Runner 命令, 一次发送 (流水线) 并打印全部回复
+ *    -S <path>: 指定套接字
+ * --watch: 监视工作空间, 保存文件后在预热的虚拟机上热重载被修改的模块并重新测量
+ *    -w <path>: lua工作目录
+ *    -s <module::function>: 入口模块与函数
+ *    -a <args>: 传递给入口函数的参数
+ *    -r <num>: 每轮运行次数, 默认 100
+ *    -n <num>: 监视的轮数, 默认一直监视
+ *    -p <num>: 记录调用树, 每轮打印与上一轮相比变化最大的 num 个函数
+ * --diff <before> <after>: 比较两份折叠栈 profile, 函数按源码位置对齐, 按影响排序
+ *    -n <num>: 显示的行数, 默认 30 (0 为全部)
+ *    -k <key>: 排序依据 self (默认) | total | calls | alloc
+ *    -o <file>: 写出差分折叠栈, 用 flamegraph.pl 生成差分火焰图
+ * --latency <profile...>: 打印每个函数 (或基准用例) 单次调用的延迟分位数 p50/p90/p99/p99.9/max,
+ *                         多个文件 (run -p 或 --bench --latency_out 的输出) 的直方图按名字合并
+ *    -n <num>: 显示的行数, 默认 30 (0 为全部)
+ *    -o <file>: 保存合并后的 profile
+ * --split <profile...>: 按帧类别拆分时间: Lua 函数, C 函数 (例如 math.sin), FFI 调用, 主 chunk
+ *                       先打印整个运行的自身时间拆分, 再按包含时间降序打印每个函数的拆分
+ *    -n <num>: 显示的行数, 默认 30 (0 为全部)
+ * --top <name>: 查看实时指标 (top 风格, 定期刷新)
+ *    -i <ms>: 刷新间隔, 默认 500ms
+ *    -n <num>: 刷新次数, 默认一直刷新
+ * --bench: 运行基准测试
+ *    --pin_cpu=<n>: 绑定到第 n 号 CPU
+ *    --raise_priority: 提高调度优先级
+ *    --live_metrics=<name>: 发布实时指标到共享内存
+ *    --latency_out=<file>: 保存每个用例的延迟直方图 (用 --latency 查看)
+ *    --benchmark_*: 传递给 google benchmark
  */
     for (auto const it: args) {
         std::cout << it << " ";
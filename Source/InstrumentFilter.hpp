@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LuaBenchmark {
+
+/* shell 风格的通配: '*' 匹配任意串 (包括 '/'), '?' 匹配一个字符 */
+inline static bool GlobMatch(std::string_view pattern, std::string_view text) {
+	size_t p = 0, t = 0;
+	size_t starP = std::string_view::npos, starT = 0;
+	while (t < text.size()) {
+		if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+			++p;
+			++t;
+		} else if (p < pattern.size() && pattern[p] == '*') {
+			starP = p++;
+			starT = t;
+		} else if (starP != std::string_view::npos) {
+			p = starP + 1;
+			t = ++starT;
+		} else {
+			return false;
+		}
+	}
+	while (p < pattern.size() && pattern[p] == '*') {
+		++p;
+	}
+	return p == pattern.size();
+}
+
+/**
+ * @brief: 插桩过滤规则, 决定哪些函数的调用/返回事件被记录
+ *     规则用逗号分隔, '+' 开头为包含, '-' 开头为排除, 形如 <kind>:<glob>
+ *     - module:<模块名>   按 require 的模块名匹配, 可以用通配 (例如 module:corpus.*)
+ *     - file:<glob>       按源文件路径匹配 (例如 file:*_test.lua, 路径不含开头的 '@')
+ *     - func:<glob>       按函数名匹配
+ *     没有包含规则时默认包含全部; 排除规则优先于包含规则
+ *     例: "+module:mod1,-func:helper*"
+ */
+class InstrumentFilter {
+public:
+	enum class Kind {
+		MODULE,
+		FILE,
+		FUNC
+	};
+	struct Rule {
+		bool bInclude {true};
+		Kind kind {Kind::FILE};
+		std::string pattern {};
+	};
+
+	static std::optional<InstrumentFilter> Parse(std::string_view spec, std::string& error) {
+		InstrumentFilter filter;
+		while (!spec.empty()) {
+			size_t comma = spec.find(',');
+			std::string_view item = spec.substr(0, comma);
+			spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+			if (item.empty()) {
+				continue;
+			}
+			Rule rule;
+			if (item.front() == '+' || item.front() == '-') {
+				rule.bInclude = item.front() == '+';
+				item.remove_prefix(1);
+			}
+			size_t colon = item.find(':');
+			std::string_view kind = colon == std::string_view::npos ? std::string_view() : item.substr(0, colon);
+			if (kind == "module") {
+				rule.kind = Kind::MODULE;
+			} else if (kind == "file") {
+				rule.kind = Kind::FILE;
+			} else if (kind == "func") {
+				rule.kind = Kind::FUNC;
+			} else {
+				error = std::format("invalid filter rule '{}', expected [+|-](module|file|func):<pattern>", item);
+				return std::nullopt;
+			}
+			rule.pattern = std::string(item.substr(colon + 1));
+			if (rule.kind == Kind::MODULE) {
+				std::replace(rule.pattern.begin(), rule.pattern.end(), '.', '/');
+			}
+			filter.AddRule(std::move(rule));
+		}
+		return filter;
+	}
+
+	void AddRule(Rule rule) {
+		(rule.bInclude ? includes : excludes).push_back(std::move(rule));
+	}
+
+	bool Empty() const {
+		return includes.empty() && excludes.empty();
+	}
+	/* source 为 lua_Debug::source (文件以 '@' 开头), name 可以为空 */
+	bool Accept(std::string_view source, std::string_view name) const {
+		if (!source.empty() && source.front() == '@') {
+			source.remove_prefix(1);
+		}
+		for (const auto& rule : excludes) {
+			if (Matches(rule, source, name)) {
+				return false;
+			}
+		}
+		if (includes.empty()) {
+			return true;
+		}
+		for (const auto& rule : includes) {
+			if (Matches(rule, source, name)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	static bool Matches(const Rule& rule, std::string_view source, std::string_view name) {
+		switch (rule.kind) {
+			case Kind::FUNC:
+				return GlobMatch(rule.pattern, name);
+			case Kind::FILE:
+				return GlobMatch(rule.pattern, source);
+			case Kind::MODULE: {
+				/* 与 package.path 中的 ?.lua, ? 与 ?/?.lua 对应, 源文件可能是绝对路径也可能是相对路径 */
+				std::string_view path = source;
+				if (path.ends_with(".lua")) {
+					path.remove_suffix(4);
+				}
+				/* x/x.lua 同时是模块 x */
+				size_t slash = path.find_last_of('/');
+				std::string_view parent {};
+				if (slash != std::string_view::npos) {
+					std::string_view dir = path.substr(0, slash);
+					if (dir.substr(dir.find_last_of('/') + 1) == path.substr(slash + 1)) {
+						parent = dir;
+					}
+				}
+				for (std::string_view candidate : {path, parent}) {
+					if (candidate.empty()) continue;
+					if (GlobMatch(rule.pattern, candidate) || GlobMatch("*/" + rule.pattern, candidate)) {
+						return true;
+					}
+				}
+				return false;
+			}
+		}
+		return false;
+	}
+
+private:
+	std::vector<Rule> includes {};
+	std::vector<Rule> excludes {};
+};
+
+} // namespace LuaBenchmark
@@ -0,0 +1,174 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: HDR 风格的对数-线性延迟直方图 (单位 ns)
+ *     小于 128 的值每个值一个桶; 之后每个 2 的幂区间平均分成 64 个桶, 相对误差小于 1/64
+ *     桶的数量固定 (BucketCount), 记录是 O(1) 的位运算加一次自增; 两个直方图的桶一一对应, 直接相加即可合并
+ *     桶数组在第一次记录时才分配, 没有数据的直方图不占用桶的内存
+ *     超过 2^40 ns (约 18 分钟) 的值计入最后一个桶, Max 仍然是精确值
+ *
+ *   文本序列化: "<count> <min> <max> <sum> <index>:<n>,<index>:<n>,...", 只写非空的桶
+ */
+class LatencyHistogram {
+public:
+	static constexpr uint32_t SubBucketBits = 7;
+	static constexpr uint64_t SubBucketCount = 1ull << SubBucketBits;
+	static constexpr uint64_t SubBucketHalf = SubBucketCount / 2;
+	static constexpr uint32_t MaxValueBits = 40;
+	static constexpr uint64_t MaxTrackedValue = (1ull << MaxValueBits) - 1;
+	static constexpr size_t BucketCount = SubBucketCount + (MaxValueBits - SubBucketBits) * SubBucketHalf;
+
+	void Record(uint64_t valueNs) {
+		if (counts.empty()) {
+			counts.resize(BucketCount, 0);
+		}
+		++counts[BucketIndex(valueNs)];
+		if (count == 0 || valueNs < minNs) minNs = valueNs;
+		maxNs = std::max(maxNs, valueNs);
+		sumNs += valueNs;
+		++count;
+	}
+
+	void Merge(const LatencyHistogram& other) {
+		if (other.count == 0) {
+			return;
+		}
+		if (counts.empty()) {
+			counts.resize(BucketCount, 0);
+		}
+		for (size_t i = 0; i < BucketCount; ++i) {
+			counts[i] += other.counts[i];
+		}
+		minNs = count == 0 ? other.minNs : std::min(minNs, other.minNs);
+		maxNs = std::max(maxNs, other.maxNs);
+		sumNs += other.sumNs;
+		count += other.count;
+	}
+
+	void Clear() {
+		*this = LatencyHistogram();
+	}
+
+	uint64_t Count() const {
+		return count;
+	}
+	uint64_t Min() const {
+		return minNs;
+	}
+	uint64_t Max() const {
+		return maxNs;
+	}
+	double Mean() const {
+		return count == 0 ? 0.0 : static_cast<double>(sumNs) / static_cast<double>(count);
+	}
+
+	/* q 取 [0, 1], 返回第 ceil(q * count) 个值所在桶的上界 (不超过 Max) */
+	uint64_t Percentile(double q) const {
+		if (count == 0) {
+			return 0;
+		}
+		const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count))));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BucketCount; ++i) {
+			seen += counts[i];
+			if (seen >= rank) {
+				return std::clamp(BucketUpperBound(i), minNs, maxNs);
+			}
+		}
+		return maxNs;
+	}
+
+	std::string Serialize() const {
+		std::string text = std::format("{} {} {} {} ", count, minNs, maxNs, sumNs);
+		bool bFirst = true;
+		for (size_t i = 0; i < counts.size(); ++i) {
+			if (counts[i] == 0) continue;
+			text += std::format("{}{}:{}", bFirst ? "" : ",", i, counts[i]);
+			bFirst = false;
+		}
+		return text;
+	}
+
+	static std::optional<LatencyHistogram> Deserialize(std::string_view text) {
+		LatencyHistogram histogram;
+		uint64_t header[4] {};
+		for (auto& value : header) {
+			while (!text.empty() && text.front() == ' ') text.remove_prefix(1);
+			auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+			if (ec != std::errc()) {
+				return std::nullopt;
+			}
+			text.remove_prefix(static_cast<size_t>(ptr - text.data()));
+		}
+		while (!text.empty() && text.front() == ' ') text.remove_prefix(1);
+		uint64_t total = 0;
+		while (!text.empty()) {
+			size_t index = 0;
+			uint64_t n = 0;
+			auto [colon, ec1] = std::from_chars(text.data(), text.data() + text.size(), index);
+			if (ec1 != std::errc() || colon == text.data() + text.size() || *colon != ':' || index >= BucketCount) {
+				return std::nullopt;
+			}
+			auto [end, ec2] = std::from_chars(colon + 1, text.data() + text.size(), n);
+			if (ec2 != std::errc()) {
+				return std::nullopt;
+			}
+			if (histogram.counts.empty()) {
+				histogram.counts.resize(BucketCount, 0);
+			}
+			histogram.counts[index] += n;
+			total += n;
+			text.remove_prefix(static_cast<size_t>(end - text.data()));
+			if (!text.empty() && text.front() == ',') text.remove_prefix(1);
+		}
+		if (total != header[0]) {
+			return std::nullopt;
+		}
+		histogram.count = header[0];
+		histogram.minNs = header[1];
+		histogram.maxNs = header[2];
+		histogram.sumNs = header[3];
+		return histogram;
+	}
+
+	static size_t BucketIndex(uint64_t value) {
+		value = std::min(value, MaxTrackedValue);
+		if (value < SubBucketCount) {
+			return static_cast<size_t>(value);
+		}
+		const uint32_t magnitude = static_cast<uint32_t>(std::bit_width(value)) - 1;
+		const uint32_t shift = magnitude - SubBucketBits + 1;
+		const uint64_t mantissa = value >> shift;
+		return static_cast<size_t>(SubBucketCount + (magnitude - SubBucketBits) * SubBucketHalf + (mantissa - SubBucketHalf));
+	}
+	static uint64_t BucketUpperBound(size_t index) {
+		if (index < SubBucketCount) {
+			return index;
+		}
+		const uint64_t offset = index - SubBucketCount;
+		const uint32_t shift = static_cast<uint32_t>(offset / SubBucketHalf) + 1;
+		const uint64_t mantissa = offset % SubBucketHalf + SubBucketHalf;
+		return ((mantissa + 1) << shift) - 1;
+	}
+
+private:
+	std::vector<uint64_t> counts {};
+	uint64_t count {0};
+	uint64_t minNs {0};
+	uint64_t maxNs {0};
+	uint64_t sumNs {0};
+};
+
+} // namespace LuaBenchmark
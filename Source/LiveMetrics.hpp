@@ -0,0 +1,433 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lua.hpp"
+}
+
+namespace LuaBenchmark {
+
+inline constexpr char LiveMetricsMagic[8] = {'L', 'P', 'L', 'I', 'V', 'E', '0', '1'};
+inline constexpr uint32_t LiveMetricsVersion = 1;
+inline constexpr size_t LiveMetricsHotFunctions = 8;
+inline constexpr size_t LiveMetricsNameBytes = 96;
+
+struct LiveHotFunction {
+	char name[LiveMetricsNameBytes];
+	uint64_t calls;
+	uint64_t totalNs;
+};
+
+/**
+ * @brief: 共享内存中发布的一份快照, 只包含定长字段, 读端按字节拷贝
+ */
+struct LiveMetricsSnapshot {
+	int64_t pid;
+	uint64_t updatedUnixMs;            /* 发布时刻, 读端用来判断数据是否过期 */
+	char source[LiveMetricsNameBytes]; /* 正在运行的虚拟机/用例 */
+	uint64_t runsCompleted;
+	uint64_t runsFailed;
+	uint64_t lastRunNs;
+	uint64_t p50Ns;                    /* 最近 LiveMetricsWindow 次运行的分位数 */
+	uint64_t p90Ns;
+	uint64_t p99Ns;
+	uint64_t maxNs;
+	uint64_t heapBytes;
+	uint64_t gcCycles;
+	uint64_t jitTraces;
+	uint32_t hotCount;
+	LiveHotFunction hot[LiveMetricsHotFunctions];
+};
+
+/**
+ * @brief: 共享内存段的布局, sequence 为 seqlock 序号 (奇数表示正在写)
+ */
+struct LiveMetricsSegment {
+	char magic[8];
+	uint32_t version;
+	uint32_t snapshotBytes;
+	std::atomic<uint64_t> sequence;
+	LiveMetricsSnapshot data;
+};
+
+inline static std::string LiveMetricsShmName(const std::string& name) {
+	return "/luaprofile." + name;
+}
+
+/**
+ * @brief: 写端, 只允许一个线程发布; 写端从不等待读端
+ *     析构时删除共享内存对象, 已经映射的读端仍能读到最后一份快照
+ */
+class LiveMetricsPublisher {
+public:
+	LiveMetricsPublisher() = default;
+	~LiveMetricsPublisher() {
+		Close();
+	}
+	LiveMetricsPublisher(const LiveMetricsPublisher&) = delete;
+	LiveMetricsPublisher& operator=(const LiveMetricsPublisher&) = delete;
+
+	bool Open(const std::string& name) {
+#ifndef _WIN32
+		Close();
+		shmName = LiveMetricsShmName(name);
+		int fd = shm_open(shmName.c_str(), O_CREAT | O_RDWR, 0644);
+		if (fd < 0) {
+			errorMessage = std::format("shm_open {} failed: {}", shmName, std::strerror(errno));
+			return false;
+		}
+		if (ftruncate(fd, sizeof(LiveMetricsSegment)) != 0) {
+			errorMessage = std::format("ftruncate {} failed: {}", shmName, std::strerror(errno));
+			close(fd);
+			shm_unlink(shmName.c_str());
+			return false;
+		}
+		void* addr = mmap(nullptr, sizeof(LiveMetricsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED) {
+			errorMessage = std::format("mmap {} failed: {}", shmName, std::strerror(errno));
+			shm_unlink(shmName.c_str());
+			return false;
+		}
+		segment = new (addr) LiveMetricsSegment{};
+		std::memcpy(segment->magic, LiveMetricsMagic, sizeof(LiveMetricsMagic));
+		segment->version = LiveMetricsVersion;
+		segment->snapshotBytes = sizeof(LiveMetricsSnapshot);
+		segment->sequence.store(0, std::memory_order_release);
+		return true;
+#else
+		(void)name;
+		errorMessage = "Live metrics require POSIX shared memory";
+		return false;
+#endif
+	}
+
+	void Close() {
+#ifndef _WIN32
+		if (!segment) {
+			return;
+		}
+		munmap(segment, sizeof(LiveMetricsSegment));
+		shm_unlink(shmName.c_str());
+		segment = nullptr;
+#endif
+	}
+
+	bool IsOpen() const {
+		return segment != nullptr;
+	}
+	const std::string& ErrorMessage() const {
+		return errorMessage;
+	}
+
+	/* seqlock 写: 序号置奇数 -> 写数据 -> 序号置偶数 */
+	void Publish(const LiveMetricsSnapshot& snapshot) {
+		if (!segment) {
+			return;
+		}
+		const uint64_t seq = segment->sequence.load(std::memory_order_relaxed);
+		segment->sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(&segment->data, &snapshot, sizeof(snapshot));
+		segment->sequence.store(seq + 2, std::memory_order_release);
+	}
+
+private:
+	LiveMetricsSegment* segment {nullptr};
+	std::string shmName {""};
+	std::string errorMessage {""};
+};
+
+/**
+ * @brief: 读端, 只读映射; 读到写了一半的数据时重试, 不会阻塞写端
+ */
+class LiveMetricsReader {
+public:
+	LiveMetricsReader() = default;
+	~LiveMetricsReader() {
+#ifndef _WIN32
+		if (segment) munmap(const_cast<LiveMetricsSegment*>(segment), sizeof(LiveMetricsSegment));
+#endif
+	}
+	LiveMetricsReader(const LiveMetricsReader&) = delete;
+	LiveMetricsReader& operator=(const LiveMetricsReader&) = delete;
+
+	bool Open(const std::string& name) {
+#ifndef _WIN32
+		const std::string shmName = LiveMetricsShmName(name);
+		int fd = shm_open(shmName.c_str(), O_RDONLY, 0);
+		if (fd < 0) {
+			errorMessage = std::format("shm_open {} failed: {}", shmName, std::strerror(errno));
+			return false;
+		}
+		struct stat st {};
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(LiveMetricsSegment)) {
+			errorMessage = std::format("{} is not a live metrics segment", shmName);
+			close(fd);
+			return false;
+		}
+		void* addr = mmap(nullptr, sizeof(LiveMetricsSegment), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED) {
+			errorMessage = std::format("mmap {} failed: {}", shmName, std::strerror(errno));
+			return false;
+		}
+		segment = static_cast<const LiveMetricsSegment*>(addr);
+		if (std::memcmp(segment->magic, LiveMetricsMagic, sizeof(LiveMetricsMagic)) != 0 ||
+			segment->version != LiveMetricsVersion || segment->snapshotBytes != sizeof(LiveMetricsSnapshot)) {
+			errorMessage = std::format("{} has an incompatible layout", shmName);
+			munmap(addr, sizeof(LiveMetricsSegment));
+			segment = nullptr;
+			return false;
+		}
+		return true;
+#else
+		(void)name;
+		errorMessage = "Live metrics require POSIX shared memory";
+		return false;
+#endif
+	}
+
+	/* 读到一致的快照返回 true; 还没有发布过或多次重试都撞上写入时返回 false */
+	bool Read(LiveMetricsSnapshot& snapshot) const {
+		if (!segment) {
+			return false;
+		}
+		for (int attempt = 0; attempt < 64; ++attempt) {
+			const uint64_t before = segment->sequence.load(std::memory_order_acquire);
+			if (before == 0) {
+				return false;
+			}
+			if (before & 1) {
+				std::this_thread::yield();
+				continue;
+			}
+			std::memcpy(&snapshot, const_cast<const LiveMetricsSnapshot*>(&segment->data), sizeof(snapshot));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (segment->sequence.load(std::memory_order_relaxed) == before) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const std::string& ErrorMessage() const {
+		return errorMessage;
+	}
+
+private:
+	const LiveMetricsSegment* segment {nullptr};
+	std::string errorMessage {""};
+};
+
+/**
+ * @brief: 单个 lua_State 的指标采集, 多个采集器可以共用一个发布端 (同一线程内)
+ *     RecordRun 只写入最近耗时的环形窗口; 距离上次发布超过 interval 时才计算分位数,
+ *     查询 JIT trace 数量并写入共享内存, 因此每次运行的开销只有一次取时间
+ */
+class LiveMetricsRecorder {
+public:
+	static constexpr size_t LiveMetricsWindow = 1024;
+
+	LiveMetricsRecorder(std::shared_ptr<LiveMetricsPublisher> publisher, lua_State* L, std::string source,
+		std::chrono::milliseconds interval = std::chrono::milliseconds(100))
+		: metricsPublisher(std::move(publisher)), luaState(L), sourceName(std::move(source)),
+		  publishInterval(interval) {
+		latencies.reserve(LiveMetricsWindow);
+		/* jit.util.traceinfo(n) 在 n 号 trace 不存在时返回 nil, 从上次的数量往后探测 */
+		const char* probe = R"(
+			local ok, util = pcall(require, "jit.util")
+			if not ok or not util.traceinfo then
+				return function() return 0 end
+			end
+			return function(n)
+				if n > 0 and not util.traceinfo(n) then
+					n = 0
+				end
+				while util.traceinfo(n + 1) do
+					n = n + 1
+				end
+				return n
+			end
+		)";
+		if (luaState && luaL_loadstring(luaState, probe) == LUA_OK && lua_pcall(luaState, 0, 1, 0) == LUA_OK) {
+			jitProbeRef = luaL_ref(luaState, LUA_REGISTRYINDEX);
+		} else if (luaState) {
+			lua_pop(luaState, 1);
+		}
+	}
+	LiveMetricsRecorder(const LiveMetricsRecorder&) = delete;
+	LiveMetricsRecorder& operator=(const LiveMetricsRecorder&) = delete;
+
+	/* 记录一次运行, 返回是否到了发布时间 */
+	bool RecordRun(uint64_t elapsedNs, bool bSuccess) {
+		bSuccess ? runsCompleted++ : runsFailed++;
+		lastRunNs = elapsedNs;
+		if (latencies.size() < LiveMetricsWindow) {
+			latencies.push_back(elapsedNs);
+		} else {
+			latencies[nextSlot] = elapsedNs;
+		}
+		nextSlot = (nextSlot + 1) % LiveMetricsWindow;
+		return std::chrono::steady_clock::now() - lastPublish >= publishInterval;
+	}
+
+	/**
+	 * @param heapBytes: 当前 Lua 堆大小
+	 * @param gcCycles: 累计 GC 周期数
+	 * @param hot: 按总耗时排好序的热点函数 (名字, 调用次数, 总耗时), 最多取前 LiveMetricsHotFunctions 个
+	 */
+	void Publish(uint64_t heapBytes, uint64_t gcCycles,
+		const std::vector<std::tuple<std::string, uint64_t, uint64_t>>& hot = {}) {
+		lastPublish = std::chrono::steady_clock::now();
+		LiveMetricsSnapshot snapshot {};
+#ifndef _WIN32
+		snapshot.pid = static_cast<int64_t>(getpid());
+#endif
+		snapshot.updatedUnixMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count());
+		CopyName(snapshot.source, sourceName);
+		snapshot.runsCompleted = runsCompleted;
+		snapshot.runsFailed = runsFailed;
+		snapshot.lastRunNs = lastRunNs;
+		if (!latencies.empty()) {
+			std::vector<uint64_t> sorted(latencies);
+			std::sort(sorted.begin(), sorted.end());
+			auto at = [&](double q) {
+				return sorted[std::min(sorted.size() - 1, static_cast<size_t>(q * static_cast<double>(sorted.size())))];
+			};
+			snapshot.p50Ns = at(0.50);
+			snapshot.p90Ns = at(0.90);
+			snapshot.p99Ns = at(0.99);
+			snapshot.maxNs = sorted.back();
+		}
+		snapshot.heapBytes = heapBytes;
+		snapshot.gcCycles = gcCycles;
+		snapshot.jitTraces = ProbeJitTraces();
+		snapshot.hotCount = static_cast<uint32_t>(std::min(hot.size(), LiveMetricsHotFunctions));
+		for (uint32_t i = 0; i < snapshot.hotCount; ++i) {
+			CopyName(snapshot.hot[i].name, std::get<0>(hot[i]));
+			snapshot.hot[i].calls = std::get<1>(hot[i]);
+			snapshot.hot[i].totalNs = std::get<2>(hot[i]);
+		}
+		metricsPublisher->Publish(snapshot);
+	}
+
+private:
+	static void CopyName(char (&dest)[LiveMetricsNameBytes], std::string_view name) {
+		const size_t len = std::min(name.size(), LiveMetricsNameBytes - 1);
+		std::memcpy(dest, name.data(), len);
+		dest[len] = '\0';
+	}
+
+	uint64_t ProbeJitTraces() {
+		if (!luaState || jitProbeRef == LUA_NOREF) {
+			return 0;
+		}
+		lua_rawgeti(luaState, LUA_REGISTRYINDEX, jitProbeRef);
+		lua_pushnumber(luaState, static_cast<lua_Number>(jitTraces));
+		if (lua_pcall(luaState, 1, 1, 0) == LUA_OK) {
+			jitTraces = static_cast<uint64_t>(lua_tonumber(luaState, -1));
+		}
+		lua_pop(luaState, 1);
+		return jitTraces;
+	}
+
+private:
+	std::shared_ptr<LiveMetricsPublisher> metricsPublisher;
+	lua_State* luaState {nullptr};
+	std::string sourceName;
+	std::chrono::milliseconds publishInterval;
+	std::chrono::steady_clock::time_point lastPublish {};
+	int jitProbeRef {LUA_NOREF};
+
+	uint64_t runsCompleted {0};
+	uint64_t runsFailed {0};
+	uint64_t lastRunNs {0};
+	uint64_t jitTraces {0};
+	std::vector<uint64_t> latencies;
+	size_t nextSlot {0};
+};
+
+/**
+ * @brief: top 风格的查看器, 附加到名为 name 的共享内存段并定期刷新, 发布进程退出后返回
+ * @param refreshCount: 刷新次数, 0 表示一直刷新
+ */
+inline static int RunLiveMetricsViewer(const std::string& name, std::chrono::milliseconds interval,
+	uint64_t refreshCount = 0) {
+	LiveMetricsReader reader;
+	if (!reader.Open(name)) {
+		std::cerr << "Error: " << reader.ErrorMessage() << "\n";
+		return 1;
+	}
+	auto formatNs = [](uint64_t ns) {
+		if (ns >= 1000000000ull) return std::format("{:.2f} s", ns / 1e9);
+		if (ns >= 1000000ull) return std::format("{:.2f} ms", ns / 1e6);
+		if (ns >= 1000ull) return std::format("{:.2f} us", ns / 1e3);
+		return std::format("{} ns", ns);
+	};
+	LiveMetricsSnapshot snapshot {};
+	for (uint64_t refresh = 0; refreshCount == 0 || refresh < refreshCount; ++refresh) {
+		if (refresh > 0) {
+			std::this_thread::sleep_for(interval);
+		}
+		std::string screen = "\x1b[H\x1b[2J";
+		if (!reader.Read(snapshot)) {
+			screen += std::format("Waiting for metrics on {} ...\n", LiveMetricsShmName(name));
+			std::cout << screen << std::flush;
+			continue;
+		}
+		const auto nowMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count());
+		screen += std::format("LuaProfile live metrics: {}   pid {}   source {}   updated {} ms ago\n\n",
+			name, snapshot.pid, snapshot.source, nowMs > snapshot.updatedUnixMs ? nowMs - snapshot.updatedUnixMs : 0);
+		screen += std::format("runs      {:>12}   failed {:>8}\n", snapshot.runsCompleted, snapshot.runsFailed);
+		screen += std::format("latency   last {:>11}   p50 {:>11}   p90 {:>11}   p99 {:>11}   max {:>11}\n",
+			formatNs(snapshot.lastRunNs), formatNs(snapshot.p50Ns), formatNs(snapshot.p90Ns),
+			formatNs(snapshot.p99Ns), formatNs(snapshot.maxNs));
+		screen += std::format("lua heap  {:>9.1f} KB   gc cycles {:>8}   jit traces {:>6}\n\n",
+			snapshot.heapBytes / 1024.0, snapshot.gcCycles, snapshot.jitTraces);
+		if (snapshot.hotCount > 0) {
+			screen += std::format("{:>10} {:>12}  {}\n", "calls", "total", "function");
+			for (uint32_t i = 0; i < snapshot.hotCount && i < LiveMetricsHotFunctions; ++i) {
+				const auto& hot = snapshot.hot[i];
+				screen += std::format("{:>10} {:>12}  {}\n", hot.calls, formatNs(hot.totalNs),
+					std::string_view(hot.name, strnlen(hot.name, LiveMetricsNameBytes)));
+			}
+		}
+		std::cout << screen << std::flush;
+#ifndef _WIN32
+		if (kill(static_cast<pid_t>(snapshot.pid), 0) != 0 && errno == ESRCH) {
+			std::cout << "\nPublisher exited.\n";
+			return 0;
+		}
+#endif
+	}
+	return 0;
+}
+
+} // namespace LuaBenchmark
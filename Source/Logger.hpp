@@ -1,14 +1,36 @@
 
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <filesystem>
 #include <iostream>
 #include <format>
 #include <fstream>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef LUAPROFILE_WITH_ZLIB
+#include <zlib.h>
+#endif
+
 enum class Level : int {
 	DEBUGINFO = 0,
 	MARK,
@@ -21,6 +43,429 @@ enum class Output {
 	FILE,    /* 输出到文件 */
 	BOTH     /* 同时输出到控制台和文件 */
 };
+/* 编译期的最低级别: Release (NDEBUG) 下 DEBUGINFO 在格式化之前就被丢弃 */
+#ifdef NDEBUG
+inline constexpr Level LoggerCompileMinLevel = Level::MARK;
+#else
+inline constexpr Level LoggerCompileMinLevel = Level::DEBUGINFO;
+#endif
+/* 线程局部的格式化/拼行缓冲区大小, 超长的行退回堆分配 */
+inline constexpr size_t LoggerLineBufferSize = 4096;
+
+enum class LogMode {
+	SYNC,  /* 调用线程直接写文件 */
+	ASYNC  /* 入队后由后台线程批量写文件 */
+};
+
+/**
+ * @brief: 异步模式的写出阈值, 缓冲的字节数或最早一行的等待时间任一超过即写出
+ */
+struct AsyncLogOptions {
+	size_t flushBytes {64 * 1024};
+	std::chrono::milliseconds flushInterval {50};
+};
+
+/**
+ * @brief: 按大小滚动日志文件
+ *     当前文件超过 maxFileBytes 后改名为 <文件名>.<序号>, 重新打开一个空文件;
+ *     最多保留 maxFiles 个旧分段, 更早的删除; bCompress 时旧分段在后台压缩为 .gz (需要 zlib)
+ */
+struct LogRotationOptions {
+	uint64_t maxFileBytes {0}; /* 0 表示不滚动 */
+	uint32_t maxFiles {8};
+	bool bCompress {false};
+};
+
+/**
+ * @brief: 固定容量的环形日志缓冲区, 写满后覆盖最早的内容, 内存占用不随运行时间增长
+ */
+class LogRingBuffer {
+public:
+	explicit LogRingBuffer(size_t capacity = 64 * 1024) : data(capacity) {}
+
+	void Append(std::string_view text) {
+		const size_t capacity = data.size();
+		if (capacity == 0 || text.empty()) {
+			droppedBytes += text.size();
+			return;
+		}
+		/* 超过容量的部分只保留最后 capacity 字节 */
+		if (text.size() > capacity) {
+			droppedBytes += text.size() - capacity;
+			text.remove_prefix(text.size() - capacity);
+		}
+		if (used + text.size() > capacity) {
+			droppedBytes += used + text.size() - capacity;
+		}
+		const size_t first = std::min(text.size(), capacity - head);
+		std::memcpy(data.data() + head, text.data(), first);
+		std::memcpy(data.data(), text.data() + first, text.size() - first);
+		head = (head + text.size()) % capacity;
+		used = std::min(capacity, used + text.size());
+	}
+	LogRingBuffer& operator+=(std::string_view text) {
+		Append(text);
+		return *this;
+	}
+
+	/* 按时间顺序取出内容; 发生过覆盖时丢掉开头不完整的一行 */
+	std::string Str() const {
+		std::string out;
+		out.reserve(used);
+		const size_t start = (head + data.size() - used) % std::max<size_t>(data.size(), 1);
+		const size_t first = std::min(used, data.size() - start);
+		out.append(data.data() + start, first);
+		out.append(data.data(), used - first);
+		if (droppedBytes > 0) {
+			size_t newline = out.find('\n');
+			out.erase(0, newline == std::string::npos ? out.size() : newline + 1);
+		}
+		return out;
+	}
+
+	/* 被覆盖或丢弃的累计字节数 */
+	uint64_t DroppedBytes() const {
+		return droppedBytes;
+	}
+	size_t Capacity() const {
+		return data.size();
+	}
+	void Clear() {
+		head = 0;
+		used = 0;
+		droppedBytes = 0;
+	}
+
+private:
+	std::vector<char> data;
+	size_t head {0};
+	size_t used {0};
+	uint64_t droppedBytes {0};
+};
+
+/**
+ * @brief: 持久打开的日志文件, 多行合并为一次 writev, 析构前可 Sync 落盘
+ */
+class LogFile {
+public:
+	explicit LogFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+		stream.open(path, std::ios::app | std::ios::binary);
+		if (!stream) {
+			throw std::runtime_error(std::format("Open Log File Failed: {}", path.string()));
+		}
+#else
+		fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (fd < 0) {
+			throw std::runtime_error(
+				std::format("Open Log File Failed: {}: {}", path.string(), std::strerror(errno))
+			);
+		}
+#endif
+		std::error_code ec;
+		auto size = std::filesystem::file_size(path, ec);
+		bytesWritten = ec ? 0 : static_cast<uint64_t>(size);
+	}
+	~LogFile() {
+#ifndef _WIN32
+		if (fd >= 0) ::close(fd);
+#endif
+	}
+	LogFile(const LogFile&) = delete;
+	LogFile& operator=(const LogFile&) = delete;
+
+	void Write(std::string_view line) {
+#ifdef _WIN32
+		stream.write(line.data(), static_cast<std::streamsize>(line.size()));
+		stream.flush();
+		bytesWritten += line.size();
+#else
+		iovec iov;
+		iov.iov_base = const_cast<char*>(line.data());
+		iov.iov_len = line.size();
+		WriteAll(&iov, 1);
+#endif
+	}
+
+	void WriteLines(const std::string* lines, size_t count) {
+#ifdef _WIN32
+		for (size_t i = 0; i < count; ++i) {
+			stream.write(lines[i].data(), static_cast<std::streamsize>(lines[i].size()));
+			bytesWritten += lines[i].size();
+		}
+		stream.flush();
+#else
+		iovec iov[MaxIovecs];
+		size_t i = 0;
+		while (i < count) {
+			size_t n = 0;
+			for (; n < MaxIovecs && i + n < count; ++n) {
+				iov[n].iov_base = const_cast<char*>(lines[i + n].data());
+				iov[n].iov_len = lines[i + n].size();
+			}
+			WriteAll(iov, n);
+			i += n;
+		}
+#endif
+	}
+
+	/* 当前文件大小 (打开时的大小加上之后写入的字节数) */
+	uint64_t Size() const {
+		return bytesWritten;
+	}
+
+	/* 把已写入的内容刷到磁盘 */
+	void Sync() {
+#ifdef _WIN32
+		stream.flush();
+#elif defined(__linux__)
+		::fdatasync(fd);
+#else
+		::fsync(fd);
+#endif
+	}
+
+private:
+#ifdef _WIN32
+	std::ofstream stream;
+#else
+	/* Linux 的 UIO_MAXIOV */
+	static constexpr size_t MaxIovecs = 1024;
+
+	void WriteAll(iovec* iov, size_t count) {
+		size_t idx = 0;
+		while (idx < count) {
+			ssize_t written = ::writev(fd, iov + idx, static_cast<int>(count - idx));
+			if (written < 0) {
+				if (errno == EINTR) continue;
+				throw std::runtime_error(std::format("Write Log File Failed: {}", std::strerror(errno)));
+			}
+			bytesWritten += static_cast<uint64_t>(written);
+			/* 处理部分写入: 跳过已写完的 iovec, 调整写了一半的那个 */
+			size_t left = static_cast<size_t>(written);
+			while (idx < count && left >= iov[idx].iov_len) {
+				left -= iov[idx].iov_len;
+				++idx;
+			}
+			if (idx < count) {
+				iov[idx].iov_base = static_cast<char*>(iov[idx].iov_base) + left;
+				iov[idx].iov_len -= left;
+			}
+		}
+	}
+
+	int fd {-1};
+#endif
+	uint64_t bytesWritten {0};
+};
+
+/**
+ * @brief: 日志分段的管理: 命名, 清理与后台压缩
+ *     分段命名为 <日志文件>.<序号>[.gz], 序号递增, 已有分段不会再被改名,
+ *     因此后台压缩与前台滚动之间不需要同步文件名
+ */
+class LogSegments {
+public:
+	LogSegments(std::filesystem::path activePath, LogRotationOptions options)
+		: basePath(std::move(activePath)), rotation(options) {
+#ifndef LUAPROFILE_WITH_ZLIB
+		if (rotation.bCompress) {
+			std::cerr << "[WARNING] Log compression requires zlib, segments are kept uncompressed\n";
+			rotation.bCompress = false;
+		}
+#endif
+		for (const auto& segment : List()) {
+			nextSequence = std::max(nextSequence, segment.first + 1);
+		}
+		if (rotation.bCompress) {
+			compressThread = std::thread([this]() { CompressLoop(); });
+		}
+	}
+	~LogSegments() {
+		if (!compressThread.joinable()) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			bStopCompress = true;
+		}
+		jobCondition.notify_one();
+		compressThread.join();
+	}
+	LogSegments(const LogSegments&) = delete;
+	LogSegments& operator=(const LogSegments&) = delete;
+
+	/* 为刚关闭的当前文件分配一个分段名 */
+	std::filesystem::path NextSegmentPath() {
+		return std::filesystem::path(basePath.string() + "." + std::to_string(nextSequence++));
+	}
+
+	/* 分段已经改名完成: 需要压缩时交给后台线程 (压缩后再清理), 否则直接清理 */
+	void OnSegmentClosed(const std::filesystem::path& segment) {
+		if (!rotation.bCompress) {
+			Prune();
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			pendingJobs.push_back(segment);
+		}
+		jobCondition.notify_one();
+	}
+
+private:
+	/* 现有分段, 按序号升序 */
+	std::vector<std::pair<uint64_t, std::filesystem::path>> List() const {
+		std::vector<std::pair<uint64_t, std::filesystem::path>> segments;
+		const auto dir = basePath.has_parent_path() ? basePath.parent_path() : std::filesystem::path(".");
+		const std::string stem = basePath.filename().string() + ".";
+		std::error_code ec;
+		for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+			std::string name = entry.path().filename().string();
+			if (name.size() <= stem.size() || name.compare(0, stem.size(), stem) != 0) {
+				continue;
+			}
+			std::string_view rest = std::string_view(name).substr(stem.size());
+			size_t digits = 0;
+			while (digits < rest.size() && rest[digits] >= '0' && rest[digits] <= '9') {
+				++digits;
+			}
+			if (digits == 0 || (digits != rest.size() && rest.substr(digits) != ".gz")) {
+				continue;
+			}
+			segments.emplace_back(std::stoull(std::string(rest.substr(0, digits))), entry.path());
+		}
+		std::sort(segments.begin(), segments.end());
+		return segments;
+	}
+
+	void Prune() {
+		auto segments = List();
+		std::error_code ec;
+		for (size_t i = 0; i + rotation.maxFiles < segments.size(); ++i) {
+			std::filesystem::remove(segments[i].second, ec);
+		}
+	}
+
+	void CompressLoop() {
+		while (true) {
+			std::filesystem::path segment;
+			{
+				std::unique_lock<std::mutex> lock(jobMutex);
+				jobCondition.wait(lock, [this]() { return bStopCompress || !pendingJobs.empty(); });
+				/* 停止前把已经排队的分段压缩完 */
+				if (pendingJobs.empty()) {
+					return;
+				}
+				segment = std::move(pendingJobs.front());
+				pendingJobs.pop_front();
+			}
+			Compress(segment);
+			Prune();
+		}
+	}
+
+	/* 先写 .gz.tmp 再改名, 中途失败时保留未压缩的分段 */
+	static void Compress(const std::filesystem::path& segment) {
+#ifdef LUAPROFILE_WITH_ZLIB
+		const std::string target = segment.string() + ".gz";
+		const std::string temp = target + ".tmp";
+		std::ifstream input(segment, std::ios::binary);
+		if (!input) {
+			/* 压缩跟不上滚动时, 排队中的分段可能已经被清理 */
+			return;
+		}
+		gzFile output = gzopen(temp.c_str(), "wb6");
+		if (!output) {
+			std::cerr << std::format("[WARNING] Compress log segment failed: {}\n", segment.string());
+			return;
+		}
+		std::vector<char> chunk(64 * 1024);
+		bool bOk = true;
+		while (bOk && input) {
+			input.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+			auto n = static_cast<unsigned>(input.gcount());
+			if (n > 0 && gzwrite(output, chunk.data(), n) != static_cast<int>(n)) {
+				bOk = false;
+			}
+		}
+		bOk = gzclose(output) == Z_OK && bOk;
+		std::error_code ec;
+		if (!bOk) {
+			std::filesystem::remove(temp, ec);
+			std::cerr << std::format("[WARNING] Compress log segment failed: {}\n", segment.string());
+			return;
+		}
+		std::filesystem::rename(temp, target, ec);
+		if (!ec) {
+			std::filesystem::remove(segment, ec);
+		}
+#else
+		(void)segment;
+#endif
+	}
+
+private:
+	std::filesystem::path basePath;
+	LogRotationOptions rotation;
+	uint64_t nextSequence {1};
+
+	std::thread compressThread;
+	std::mutex jobMutex;
+	std::condition_variable jobCondition;
+	std::deque<std::filesystem::path> pendingJobs;
+	bool bStopCompress {false};
+};
+
+/**
+ * @brief: 多生产者单消费者的无锁队列 (Vyukov MPSC)
+ *     生产者只做一次 exchange 和一次 store, 不会互相阻塞; Pop/Empty 只能由唯一的消费者调用
+ */
+class LogLineQueue {
+	struct Node {
+		std::atomic<Node*> next {nullptr};
+		std::string line;
+	};
+public:
+	LogLineQueue() {
+		Node* stub = new Node;
+		head.store(stub, std::memory_order_relaxed);
+		tail = stub;
+	}
+	~LogLineQueue() {
+		std::string line;
+		while (Pop(line)) {}
+		delete tail;
+	}
+	LogLineQueue(const LogLineQueue&) = delete;
+	LogLineQueue& operator=(const LogLineQueue&) = delete;
+
+	void Push(std::string line) {
+		Node* node = new Node;
+		node->line = std::move(line);
+		Node* prev = head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	bool Pop(std::string& line) {
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (!next) {
+			return false;
+		}
+		line = std::move(next->line);
+		delete tail;
+		tail = next;
+		return true;
+	}
+
+	bool Empty() const {
+		return tail->next.load(std::memory_order_acquire) == nullptr;
+	}
+
+private:
+	std::atomic<Node*> head {nullptr};
+	Node* tail {nullptr};
+};
 
 
 struct Logger{
@@ -34,8 +479,10 @@ public:
 	std::string commonPrefix{""};
 public:
 	
-	Logger(std::string prefix, std::string startmsg, std::string endmsg, LogFilePath path)
-		: commonPrefix(prefix), logStartMsg(startmsg), logEndMsg(endmsg), logFilePath(path) {
+	Logger(std::string prefix, std::string startmsg, std::string endmsg, LogFilePath path,
+		LogMode mode=LogMode::SYNC, AsyncLogOptions options={}, LogRotationOptions rotation={})
+		: commonPrefix(prefix), logStartMsg(startmsg), logEndMsg(endmsg), logFilePath(path),
+		  logMode(mode), asyncOptions(options), rotationOptions(rotation) {
 		if (logFilePath.empty()) {
 			const std::string errMsg = "Path is empty \n";
 			std::cerr << errMsg;
@@ -64,12 +511,22 @@ public:
 				}
 				ofs.close();
 			}
+			/* 文件句柄在 Logger 的整个生命周期内保持打开 */
+			logFile = std::make_unique<LogFile>(logFilePath);
+			if (rotationOptions.maxFileBytes > 0) {
+				segments = std::make_unique<LogSegments>(logFilePath, rotationOptions);
+			}
+			if (logMode == LogMode::ASYNC) {
+				lineQueue = std::make_unique<LogLineQueue>();
+				writerThread = std::thread([this]() { WriterLoop(); });
+			}
 			if (!logStartMsg.empty()){
 				OutputMessage(Position::START, Level::MARK, logStartMsg, Output::BOTH);
 			}
 			
 		}catch(const std::runtime_error& runtime_error){
 			std::cerr << runtime_error.what() << "\n";
+			StopWriter();
 			throw runtime_error;
 		}
 	}
@@ -83,79 +540,417 @@ public:
 			if (!logEndMsg.empty()) [[unlikely]] {
 				OutputMessage(Position::END, Level::MARK, logEndMsg, Output::BOTH);
 			}
+			StopWriter();
+			if (logFile) {
+				logFile->Sync();
+			}
+			/* 等待后台压缩完成 */
+			segments.reset();
 		}catch (const std::runtime_error& e){
 			std::cerr << e.what() << "\n";
 		}
 	}
 
-	void Log(Level level, const std::string& message, Output output=Output::BOTH){
+	void Log(Level level, std::string_view message, Output output=Output::BOTH){
 		OutputMessage(Position::MIDDLE, level, message, output);
 	}
+
+	/**
+	 * @brief: 带格式化的日志, 格式串在编译期检查
+	 *     级别被过滤时直接返回, 不格式化参数; 否则格式化到线程局部缓冲区, 超长截断
+	 */
+	template <typename... Args>
+	void Log(Level level, Output output, std::format_string<Args...> fmt, Args&&... args){
+		if (!IsEnabled(level)) {
+			return;
+		}
+		thread_local char buffer[LoggerLineBufferSize];
+		auto result = std::format_to_n(buffer, sizeof(buffer), fmt, std::forward<Args>(args)...);
+		size_t len = std::min(static_cast<size_t>(result.size), sizeof(buffer));
+		OutputMessage(Position::MIDDLE, level, std::string_view(buffer, len), output);
+	}
+
+	/**
+	 * @brief: 写入已经按文件格式拼好的若干整行 (见 FormatFileLine)
+	 *     整块作为一个单元写出, 不会与其他线程写入的内容交错
+	 */
+	void AppendLines(std::string lines){
+		if (lines.empty()) {
+			return;
+		}
+		if (logMode == LogMode::ASYNC) {
+			PushToWriter(std::move(lines));
+			return;
+		}
+		std::lock_guard<std::mutex> lock(fileMutex);
+		if (logFile) {
+			logFile->Write(lines);
+			RotateIfNeeded();
+		}
+	}
+
+	/* 按写入文件的格式拼出一行并追加到 out */
+	static void FormatFileLine(std::string& out, Level level, std::string_view prefix, std::string_view message){
+		std::string_view tag = LevelTag(level);
+		out.reserve(out.size() + tag.size() + prefix.size() + message.size() + 2);
+		out.append(tag).append(prefix).append(message).append("\n\n");
+	}
+
+	/* 运行期的最低级别, 与编译期的 LoggerCompileMinLevel 同时生效 */
+	void SetMinLevel(Level level){
+		minLevel = level;
+	}
+	bool IsEnabled(Level level) const {
+		return level >= LoggerCompileMinLevel && level >= minLevel;
+	}
 private:
 	enum class Position {
 		START,
 		MIDDLE,
 		END
 	};
-	void OutputMessage(Position pos, Level level, const std::string& message, Output output=Output::BOTH){ 
-		std::string realMsg;
+	static std::string_view LevelTag(Level level){
+		switch (level) {
+			case Level::INFO: return "\t[INFO]: ";
+			case Level::WARNING: return "\t[WARNING]: ";
+			case Level::ERROR: return "\t[ERROR]: ";
+			case Level::DEBUGINFO: return "\t[DEBUG]: ";
+			default: return "\t[UNKNOWN]: ";
+		}
+	}
+	void OutputMessage(Position pos, Level level, std::string_view message, Output output=Output::BOTH){ 
+		if (pos == Position::MIDDLE && !IsEnabled(level)) {
+			return;
+		}
+		std::string_view tag {};
+		std::string_view prefix {};
+		std::string_view body = message;
+		std::string_view suffix {};
 		if (pos == Position::START){
-			realMsg = logStartMsg;
+			body = logStartMsg;
 		} else if (pos == Position::END){
-			realMsg = logEndMsg;
+			body = logEndMsg;
+		} else if (level == Level::MARK){
+			tag = "\t[UNKNOWN]: ";
 		} else {
-			if (level == Level::INFO){
-				realMsg = "\t[INFO]: " + commonPrefix + message + "\n";
-			}else if (level == Level::WARNING){
-				realMsg = "\t[WARNING]: " + commonPrefix + message + "\n";
-			}else if (level == Level::ERROR){
-				realMsg = "\t[ERROR]: " + commonPrefix + message + "\n";
-			}else if (level == Level::DEBUGINFO){
-			#ifndef NDEBUG
-				realMsg = "\t[DEBUG]: " + commonPrefix + message + "\n";
-			#else
-				return;
-			#endif
-			}else {
-				realMsg = "\t[UNKNOWN]: " + message;
-			
-			}
+			tag = LevelTag(level);
+			prefix = commonPrefix;
+			suffix = "\n";
+		}
+		const size_t len = tag.size() + prefix.size() + body.size() + suffix.size();
+		if (len == 0) return;
+
+		/* 整行 (外加文件中的换行) 拼在线程局部缓冲区里, 超长时才退回 std::string */
+		thread_local char lineBuffer[LoggerLineBufferSize];
+		std::string overflow;
+		char* line = lineBuffer;
+		if (len + 1 > sizeof(lineBuffer)) {
+			overflow.resize(len + 1);
+			line = overflow.data();
 		}
-		if (realMsg.empty()) return;
+		char* cursor = line;
+		for (std::string_view part : {tag, prefix, body, suffix}) {
+			std::memcpy(cursor, part.data(), part.size());
+			cursor += part.size();
+		}
+		*cursor = '\n';
+
 		if (output == Output::CONSOLE || output == Output::BOTH) {
-			std::cout << realMsg;
+			std::cout.write(line, static_cast<std::streamsize>(len));
 		}
 		if (output == Output::FILE || output == Output::BOTH){
-			WriteMessageToFile(realMsg);
+			WriteMessageToFile(std::string_view(line, len + 1));
 		}
 
 	}
 
-	void WriteMessageToFile(std::string msg){
-		if (logFilePath.empty()) [[unlikely]] {
+	/* line 已经包含结尾的换行 */
+	void WriteMessageToFile(std::string_view line){
+		if (!logFile) [[unlikely]] {
 			throw std::runtime_error(
-				std::format("Log File Path: {} is empty", logFilePath.string())
+				std::format("Log File: {} is not open", logFilePath.string())
 			);
 		}
-		if (msg.empty()) [[unlikely]] {
+		if (line.empty()) [[unlikely]] {
 			return;
 		}
-		std::ofstream logFile(logFilePath, std::ios::app); 
-		if (logFile.is_open()) {
-			logFile << msg << "\n";
-			logFile.close();
-		} else {
-			throw std::runtime_error(
-				std::format("Open Log File Failed: {}", logFilePath.string())
-			);
+		if (logMode == LogMode::ASYNC) {
+			/* 队列节点需要持有整行, 异步模式下每行一次分配 */
+			PushToWriter(std::string(line));
+			return;
 		}
-		
+		std::lock_guard<std::mutex> lock(fileMutex);
+		if (logFile) {
+			logFile->Write(line);
+			RotateIfNeeded();
+		}
+	}
+
+	/**
+	 * @brief: 当前文件超过上限时滚动; 同步模式下在 fileMutex 内调用, 异步模式下只由写线程调用
+	 *     滚动在整块写出之后进行, 一行不会被拆到两个分段
+	 *     新文件打开成功后才替换旧的句柄; 打开失败时把分段改回原名, 继续写原来的文件
+	 */
+	void RotateIfNeeded(){
+		if (!logFile || !segments || logFile->Size() < rotationOptions.maxFileBytes) {
+			return;
+		}
+		logFile->Sync();
+#ifdef _WIN32
+		/* Windows 上不能改名仍然打开的文件, 先关闭 */
+		logFile.reset();
+#endif
+		auto segment = segments->NextSegmentPath();
+		std::error_code ec;
+		std::filesystem::rename(logFilePath, segment, ec);
+		if (ec) {
+			std::cerr << std::format("[WARNING] Rotate log file failed: {}: {}\n", logFilePath.string(), ec.message());
+#ifdef _WIN32
+			logFile = OpenLogFile(logFilePath);
+#endif
+			return;
+		}
+		auto next = OpenLogFile(logFilePath);
+		if (!next) {
+			std::filesystem::rename(segment, logFilePath, ec);
+#ifdef _WIN32
+			logFile = OpenLogFile(logFilePath);
+#endif
+			return;
+		}
+		logFile = std::move(next);
+		segments->OnSegmentClosed(segment);
+	}
+
+	/* 打开失败时返回空指针, 由调用者保留原来的句柄 */
+	static std::unique_ptr<LogFile> OpenLogFile(const std::filesystem::path& path){
+		try {
+			return std::make_unique<LogFile>(path);
+		} catch (const std::runtime_error& e) {
+			std::cerr << std::format("[WARNING] {}\n", e.what());
+			return nullptr;
+		}
+	}
+
+	void PushToWriter(std::string&& lines){
+		lineQueue->Push(std::move(lines));
+		/* 只有写线程在等待时才需要唤醒, 高频日志下不会碰到锁 */
+		if (writerIdle.load()) {
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			wakeCondition.notify_one();
+		}
+	}
+
+	/**
+	 * @brief: 后台写线程, 取出队列中的所有行攒成一批,
+	 *     批量大小超过 flushBytes 或最早一行等待超过 flushInterval 时用一次 writev 写出
+	 */
+	void WriterLoop(){
+		using Clock = std::chrono::steady_clock;
+		std::vector<std::string> batch;
+		size_t batchBytes = 0;
+		Clock::time_point batchStart = Clock::now();
+		std::string line;
+
+		auto flush = [&]() {
+			try {
+				if (logFile) {
+					logFile->WriteLines(batch.data(), batch.size());
+					RotateIfNeeded();
+				}
+			} catch (const std::runtime_error& e) {
+				std::cerr << e.what() << "\n";
+			}
+			batch.clear();
+			batchBytes = 0;
+		};
+
+		while (true) {
+			/* 先读停止标志再取队列, 保证停止前入队的行都会被写出 */
+			bool bStopping = stopWriter.load(std::memory_order_acquire);
+			while (lineQueue->Pop(line)) {
+				if (batch.empty()) {
+					batchStart = Clock::now();
+				}
+				batchBytes += line.size();
+				batch.push_back(std::move(line));
+				if (batchBytes >= asyncOptions.flushBytes) {
+					flush();
+				}
+			}
+			auto waited = Clock::now() - batchStart;
+			if (!batch.empty() && (bStopping || waited >= asyncOptions.flushInterval)) {
+				flush();
+			}
+			if (bStopping) {
+				break;
+			}
+
+			auto timeout = batch.empty()
+				? std::chrono::duration_cast<Clock::duration>(asyncOptions.flushInterval)
+				: std::chrono::duration_cast<Clock::duration>(asyncOptions.flushInterval) - waited;
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			writerIdle.store(true);
+			wakeCondition.wait_for(lock, timeout, [this]() {
+				return stopWriter.load() || !lineQueue->Empty();
+			});
+			writerIdle.store(false);
+		}
+	}
+
+	void StopWriter(){
+		if (!writerThread.joinable()) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			stopWriter.store(true, std::memory_order_release);
+			wakeCondition.notify_one();
+		}
+		writerThread.join();
+	}
+
+private:
+	Level minLevel {Level::DEBUGINFO};
+	LogMode logMode {LogMode::SYNC};
+	AsyncLogOptions asyncOptions {};
+	LogRotationOptions rotationOptions {};
+	std::unique_ptr<LogFile> logFile {nullptr};
+	std::unique_ptr<LogSegments> segments {nullptr};
+	std::mutex fileMutex;
+
+	std::unique_ptr<LogLineQueue> lineQueue {nullptr};
+	std::thread writerThread;
+	std::atomic<bool> stopWriter {false};
+	std::atomic<bool> writerIdle {false};
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+};
+
+/**
+ * @brief: 命名日志通道 (每个 LuaVM 一个), 底层写入一个 Logger
+ *     各线程先把整行追加到自己的线程局部缓冲区, 写入路径上没有锁;
+ *     缓冲区超过 flushBytes, 调用 Flush() 或线程退出时, 整块交给 Logger,
+ *     因此多个线程的行不会交错, 也不需要全局锁
+ */
+class LogChannel : public std::enable_shared_from_this<LogChannel> {
+	/* 某个线程写往某个通道的缓冲区; 通过 weak_ptr 引用通道, 通道先销毁时直接丢弃 */
+	struct ThreadBuffer {
+		std::weak_ptr<LogChannel> channel;
+		std::string pending;
+	};
+	/* 线程退出时把本线程所有通道的缓冲区刷出 */
+	struct ThreadBuffers {
+		std::unordered_map<uint64_t, ThreadBuffer> buffers;
+		uint64_t lastId {0};
+		ThreadBuffer* last {nullptr};
+		~ThreadBuffers() {
+			for (auto& [id, buffer] : buffers) {
+				if (auto channel = buffer.channel.lock()) {
+					channel->sink->AppendLines(std::move(buffer.pending));
+				}
+			}
+		}
+	};
+	static ThreadBuffers& LocalBuffers() {
+		thread_local ThreadBuffers buffers;
+		return buffers;
+	}
+	static uint64_t NextChannelId() {
+		static std::atomic<uint64_t> nextId {1};
+		return nextId.fetch_add(1, std::memory_order_relaxed);
+	}
+
+public:
+	LogChannel(std::string name, std::shared_ptr<Logger> logger, size_t flushBytes = 16 * 1024)
+		: channelName(std::move(name)), sink(std::move(logger)), threadFlushBytes(flushBytes),
+		  channelId(NextChannelId()) {}
+	LogChannel(const LogChannel&) = delete;
+	LogChannel& operator=(const LogChannel&) = delete;
+
+	const std::string& Name() const {
+		return channelName;
+	}
+	const std::shared_ptr<Logger>& Sink() const {
+		return sink;
+	}
+
+	void Log(Level level, std::string_view message, Output output=Output::FILE){
+		if (!sink->IsEnabled(level)) {
+			return;
+		}
+		if (output == Output::CONSOLE || output == Output::BOTH) {
+			std::string line;
+			Logger::FormatFileLine(line, level, sink->commonPrefix, message);
+			/* 一次写出整行, 控制台上也不会交错 */
+			std::cout.write(line.data(), static_cast<std::streamsize>(line.size() - 1));
+		}
+		if (output == Output::FILE || output == Output::BOTH) {
+			ThreadBuffer& buffer = LocalBuffer();
+			Logger::FormatFileLine(buffer.pending, level, sink->commonPrefix, message);
+			if (buffer.pending.size() >= threadFlushBytes) {
+				FlushBuffer(buffer);
+			}
+		}
+	}
+
+	template <typename... Args>
+	void Log(Level level, Output output, std::format_string<Args...> fmt, Args&&... args){
+		if (!sink->IsEnabled(level)) {
+			return;
+		}
+		thread_local char buffer[LoggerLineBufferSize];
+		auto result = std::format_to_n(buffer, sizeof(buffer), fmt, std::forward<Args>(args)...);
+		size_t len = std::min(static_cast<size_t>(result.size), sizeof(buffer));
+		Log(level, std::string_view(buffer, len), output);
+	}
+
+	/* 把调用线程写往本通道的缓冲区交给 Logger */
+	void Flush(){
+		FlushBuffer(LocalBuffer());
+	}
+
+private:
+	ThreadBuffer& LocalBuffer(){
+		ThreadBuffers& local = LocalBuffers();
+		if (local.last && local.lastId == channelId) [[likely]] {
+			return *local.last;
+		}
+		auto [it, bInserted] = local.buffers.try_emplace(channelId);
+		if (bInserted) {
+			it->second.channel = weak_from_this();
+			it->second.pending.reserve(threadFlushBytes);
+			/* 通道编号不复用, 已销毁通道的条目不会再被访问; 新增条目时顺便清理, 否则随通道的增删一直增长 */
+			std::erase_if(local.buffers, [](const auto& entry) {
+				return entry.second.channel.expired();
+			});
+		}
+		local.lastId = channelId;
+		local.last = &it->second;
+		return it->second;
 	}
 
+	void FlushBuffer(ThreadBuffer& buffer){
+		if (buffer.pending.empty()) {
+			return;
+		}
+		std::string block;
+		block.reserve(threadFlushBytes);
+		block.swap(buffer.pending);
+		sink->AppendLines(std::move(block));
+	}
+
+private:
+	std::string channelName;
+	std::shared_ptr<Logger> sink;
+	size_t threadFlushBytes;
+	uint64_t channelId;
 };
 
 /**
-* @brief: 日志记录单例类
+* @brief: 日志记录单例类, 管理命名的日志通道
+*     注册/注销通道时加写锁, 按名字或编号查找时加读锁;
+*     热路径上调用方直接持有 LogChannel, 不经过 LoggerManager
 */
 class LoggerManager{
 public:
@@ -166,23 +961,103 @@ public:
 	
 public:
 	void SetLogOutputPath(const std::filesystem::path& path){
+		std::unique_lock lock(channelMutex);
 		logFilePath = path;
 	}
+
+	/* 之后新建的通道使用的滚动策略, 长时间运行时用来限制磁盘占用 */
+	void SetRotation(const LogRotationOptions& options){
+		std::unique_lock lock(channelMutex);
+		rotationOptions = options;
+	}
+
+	/**
+	 * @brief 获取名为 name 的通道, 不存在时创建, 日志写入 <日志目录>/<name>.log
+	 * @param mode 新建通道时底层 Logger 的写入方式
+	 */
+	std::shared_ptr<LogChannel> Channel(const std::string& name, LogMode mode=LogMode::ASYNC){
+		{
+			std::shared_lock lock(channelMutex);
+			if (auto it = channelIndex.find(name); it != channelIndex.end()) {
+				return channels[it->second];
+			}
+		}
+		std::unique_lock lock(channelMutex);
+		if (auto it = channelIndex.find(name); it != channelIndex.end()) {
+			return channels[it->second];
+		}
+		auto logger = std::make_shared<Logger>(
+			std::format("[{}] ", name),
+			std::format("=== Channel {} Start ===", name),
+			std::format("=== Channel {} End ===", name),
+			logFilePath / (name + ".log"),
+			mode,
+			AsyncLogOptions{},
+			rotationOptions
+		);
+		auto channel = std::make_shared<LogChannel>(name, std::move(logger));
+		channelIndex[name] = static_cast<uint32_t>(channels.size());
+		channels.push_back(channel);
+		return channel;
+	}
+
+	std::shared_ptr<LogChannel> FindChannel(const std::string& name){
+		std::shared_lock lock(channelMutex);
+		auto it = channelIndex.find(name);
+		return it == channelIndex.end() ? nullptr : channels[it->second];
+	}
+
+	/* 注销通道; 仍被持有的 LogChannel 会在最后一个引用释放时关闭文件 */
+	void RemoveChannel(const std::string& name){
+		std::unique_lock lock(channelMutex);
+		auto it = channelIndex.find(name);
+		if (it == channelIndex.end()) {
+			return;
+		}
+		/* 留下空位, 其余通道的编号不变 (调用方可能仍持有编号) */
+		channels[it->second] = nullptr;
+		channelIndex.erase(it);
+	}
+
+	std::vector<std::string> ChannelNames(){
+		std::shared_lock lock(channelMutex);
+		std::vector<std::string> names;
+		names.reserve(channels.size());
+		for (const auto& channel : channels) {
+			if (channel) {
+				names.push_back(channel->Name());
+			}
+		}
+		return names;
+	}
+
 	/**
 	 * @brief 往loggerIdx 号日志中写入日志
-	 * @param loggerId 日志编号
+	 * @param loggerId 日志编号 (按通道创建顺序, 注销的通道不释放编号)
 	 * @param level 日志等级
 	 * @param message 日志内容
 	 * @param output 日志输出位置
 	*/
 	void Log(uint32_t loggerIdx, Level level, const std::string& message, Output output=Output::BOTH){
-		if (loggerIdx >= loggers.size()) [[unlikely]]{
-			std::cerr << "[ERROR] Logger index out of range: " << loggerIdx << "\n";
-			return;
+		std::shared_ptr<LogChannel> channel;
+		{
+			std::shared_lock lock(channelMutex);
+			if (loggerIdx >= channels.size() || !channels[loggerIdx]) [[unlikely]]{
+				std::cerr << "[ERROR] Logger index out of range or removed: " << loggerIdx << "\n";
+				return;
+			}
+			channel = channels[loggerIdx];
 		}
-		loggers[loggerIdx].Log(level, message, output);
+		channel->Log(level, message, output);
 
 	}
+	void Log(const std::string& name, Level level, const std::string& message, Output output=Output::BOTH){
+		if (auto channel = FindChannel(name)) {
+			channel->Log(level, message, output);
+		} else {
+			std::cerr << "[ERROR] Log channel not found: " << name << "\n";
+		}
+	}
 private:
 	LoggerManager(std::string path="./Log") : logFilePath(path){
 		
@@ -193,6 +1068,8 @@ private:
 
 private:
 	std::filesystem::path logFilePath{""};
-	std::vector<Logger> loggers;
+	LogRotationOptions rotationOptions {};
+	std::shared_mutex channelMutex;
+	std::vector<std::shared_ptr<LogChannel>> channels;
+	std::unordered_map<std::string, uint32_t> channelIndex;
 };
-
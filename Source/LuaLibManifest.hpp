@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lua.hpp"
+}
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: 虚拟机打开的标准库清单, 短命的虚拟机只打开需要的库可以明显缩短启动时间
+ *     base 与 package 总是打开: LuaVM 依赖 require 与 package.path 加载工作空间中的模块
+ *     coroutine 属于 base; ffi 与 luaL_openlibs 一样只注册到 package.preload, 脚本 require("ffi") 时才加载
+ */
+struct LuaLibManifest {
+	enum Lib : uint32_t {
+		BASE    = 1u << 0,
+		PACKAGE = 1u << 1,
+		TABLE   = 1u << 2,
+		IO      = 1u << 3,
+		OS      = 1u << 4,
+		STRING  = 1u << 5,
+		MATH    = 1u << 6,
+		DEBUG   = 1u << 7,
+		BIT     = 1u << 8,
+		JIT     = 1u << 9,
+		FFI     = 1u << 10,
+	};
+	static constexpr uint32_t Required = BASE | PACKAGE;
+	static constexpr uint32_t Everything = (FFI << 1) - 1;
+
+	uint32_t libs {Everything};
+
+	static LuaLibManifest All() {
+		return {Everything};
+	}
+	static LuaLibManifest Minimal() {
+		return {Required};
+	}
+
+	/* "all" 或逗号分隔的库名, 例如 "base,math,string,jit,ffi" */
+	static std::optional<LuaLibManifest> Parse(std::string_view spec, std::string& error) {
+		if (spec.empty() || spec == "all") {
+			return All();
+		}
+		LuaLibManifest manifest {Required};
+		while (!spec.empty()) {
+			size_t comma = spec.find(',');
+			std::string_view name = spec.substr(0, comma);
+			spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+			if (name.empty()) {
+				continue;
+			}
+			bool bFound = false;
+			for (const auto& entry : Entries) {
+				if (name == entry.name) {
+					manifest.libs |= entry.lib;
+					bFound = true;
+					break;
+				}
+			}
+			if (!bFound) {
+				error = std::format("unknown Lua library '{}'", name);
+				return std::nullopt;
+			}
+		}
+		return manifest;
+	}
+
+	bool Has(Lib lib) const {
+		return (libs & lib) != 0;
+	}
+	bool IsAll() const {
+		return (libs & Everything) == Everything;
+	}
+
+	std::string ToString() const {
+		if (IsAll()) {
+			return "all";
+		}
+		std::string names;
+		for (const auto& entry : Entries) {
+			if (Has(entry.lib)) {
+				if (!names.empty()) names += ',';
+				names += entry.name;
+			}
+		}
+		return names;
+	}
+
+	/* 顺序与 LuaJIT 的 luaL_openlibs 相同 */
+	void Open(lua_State* L) const {
+		if (IsAll()) {
+			luaL_openlibs(L);
+			return;
+		}
+		for (const auto& entry : Entries) {
+			if (!entry.open || !Has(entry.lib)) {
+				continue;
+			}
+			lua_pushcfunction(L, entry.open);
+			lua_pushstring(L, entry.module);
+			lua_call(L, 1, 0);
+		}
+		if (Has(FFI)) {
+			lua_getglobal(L, "package");
+			lua_getfield(L, -1, "preload");
+			lua_pushcfunction(L, luaopen_ffi);
+			lua_setfield(L, -2, LUA_FFILIBNAME);
+			lua_pop(L, 2);
+		}
+	}
+
+private:
+	struct Entry {
+		Lib lib;
+		const char* name;
+		const char* module;
+		lua_CFunction open;
+	};
+	static constexpr Entry Entries[] = {
+		{BASE,    "base",    "",              luaopen_base},
+		{PACKAGE, "package", LUA_LOADLIBNAME, luaopen_package},
+		{TABLE,   "table",   LUA_TABLIBNAME,  luaopen_table},
+		{IO,      "io",      LUA_IOLIBNAME,   luaopen_io},
+		{OS,      "os",      LUA_OSLIBNAME,   luaopen_os},
+		{STRING,  "string",  LUA_STRLIBNAME,  luaopen_string},
+		{MATH,    "math",    LUA_MATHLIBNAME, luaopen_math},
+		{DEBUG,   "debug",   LUA_DBLIBNAME,   luaopen_debug},
+		{BIT,     "bit",     LUA_BITLIBNAME,  luaopen_bit},
+		{JIT,     "jit",     LUA_JITLIBNAME,  luaopen_jit},
+		{FFI,     "ffi",     LUA_FFILIBNAME,  nullptr},
+	};
+};
+
+} // namespace LuaBenchmark
@@ -1,17 +1,23 @@
 
 #pragma once
 
+#include <algorithm>
 #include <benchmark/benchmark.h>
 #include <chrono>
+#include <climits>
 #include <cstdint>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <functional>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <regex>
 #include <stack>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <optional>
 #include <iostream>
 #include <utility>
@@ -23,16 +29,45 @@ extern "C" {
 #include "lua.hpp"
 }
 #include  "Tools.hpp"
+#include "Logger.hpp"
+#include "MemoryStats.hpp"
+#include "TraceFormat.hpp"
+#include "ChromeTrace.hpp"
+#include "LiveMetrics.hpp"
+#include "MappedInput.hpp"
+#include "CallTree.hpp"
+#include "LuaLibManifest.hpp"
+#include "InstrumentFilter.hpp"
 namespace LuaBenchmark {
 inline static void PushLog();
 inline static void LuaHook(lua_State* L, lua_Debug* ar);
 
 
+/* 运行被预算中止的原因 */
+enum class LuaAbortReason : uint8_t {
+	NONE = 0,
+	INSTRUCTIONS,   /* 超出指令预算 */
+	MEMORY,         /* 超出 Lua 堆上限 */
+	DEADLINE        /* 超出墙钟时间 */
+};
+
+inline static const char* LuaAbortReasonName(LuaAbortReason reason) {
+	switch (reason) {
+		case LuaAbortReason::INSTRUCTIONS: return "instructions";
+		case LuaAbortReason::MEMORY: return "memory";
+		case LuaAbortReason::DEADLINE: return "deadline";
+		default: return "none";
+	}
+}
+
 struct LuaResult{
 	bool bSuccess {false};
 	std::string msgError {};
+	LuaAbortReason abortReason {LuaAbortReason::NONE};
 	std::optional<double> luaResult {std::nullopt};
 	std::optional<std::string> luaLog {std::nullopt};
+	LuaMemoryStats luaMemory {};
+	bool bCallHooks {false};  /* 运行开始时是否安装了调用/返回钩子, 为 true 时计时包含插桩开销 */
 	LuaResult() 
 		: bSuccess(false), msgError(""), luaResult(std::nullopt), luaLog(std::nullopt) {}
 	LuaResult(bool ret, std::string error, 
@@ -46,39 +81,646 @@ struct LuaResult{
 };
 
 
+/**
+ * @brief: 钩子开销的估计, 由 LuaVM::CalibrateHookOverhead 用空函数标定
+ *     perCallNs: 一次调用的调用钩子加返回钩子的总开销
+ *     innerNs: 其中落在被调函数计时区间内的部分 (调用事件取时间戳之后的记录, 返回事件取时间戳之前的查询),
+ *         其余部分落在调用者的计时区间内
+ */
+struct LuaHookOverhead {
+	uint64_t perCallNs {0};
+	uint64_t innerNs {0};
+};
+
 struct LuaProfileReportor{
 	using TimeClock = std::chrono::high_resolution_clock;
 	using TimePoint = TimeClock::time_point;
-	
+
+	/**
+	 * @brief: 开启二进制 trace, 之后的调用/返回事件写入 path (mmap 环形文件)
+	 *     用 LuaTraceDecoder 离线转换成文本, JSON 或汇总的 profile
+	 */
+	bool EnableBinaryTrace(const std::filesystem::path& path) {
+		traceWriter = std::make_unique<TraceWriter>();
+		if (!traceWriter->Open(path)) {
+			LOG(Error, "EnableBinaryTrace failed: {}", traceWriter->ErrorMessage());
+			traceWriter.reset();
+			return false;
+		}
+		traceStart = TimeClock::now();
+		++traceGeneration;
+		traceState = nullptr;
+		traceThreads.clear();
+		lastTraceHeapNs = 0;
+		return true;
+	}
+	void DisableBinaryTrace() {
+		traceWriter.reset();
+	}
+
+	/**
+	 * @brief: 开启时间线导出, 调用/返回写成 Chrome Trace Event JSON 的切片
+	 *     每个 Lua 线程/协程一条轨道, 另有 Lua 堆大小的计数器轨道; 用 Perfetto UI 打开
+	 */
+	bool EnableChromeTrace(const std::filesystem::path& path) {
+		chromeTrace = std::make_unique<ChromeTraceWriter>();
+		if (!chromeTrace->Open(path)) {
+			LOG(Error, "EnableChromeTrace failed: {}", chromeTrace->ErrorMessage());
+			chromeTrace.reset();
+			return false;
+		}
+		chromeStart = TimeClock::now();
+		++chromeGeneration;
+		chromePid = CurrentTraceThreadId();
+		chromeState = nullptr;
+		chromeTracks.clear();
+		lastHeapSampleNs = 0;
+		chromeTrace->ProcessName(chromePid, std::format("Lua thread {}", chromePid));
+		return true;
+	}
+	void DisableChromeTrace() {
+		chromeTrace.reset();
+	}
+
+	/**
+	 * @brief: 按函数累计调用次数与总耗时 (含子调用), 供实时指标显示热点函数
+	 *     以 (源文件, 定义行) 为键; 统计项的地址缓存在函数的符号中, 之后的调用不再查找
+	 */
+	void EnableFunctionStats(bool bEnable = true) {
+		bFunctionStats = bEnable;
+	}
+	/* 按总耗时降序取前 count 个函数: (名字, 调用次数, 总耗时 ns) */
+	std::vector<std::tuple<std::string, uint64_t, uint64_t>> TopFunctions(size_t count) const {
+		std::vector<std::tuple<std::string, uint64_t, uint64_t>> top;
+		top.reserve(functionStats.size());
+		for (const auto& [key, stats] : functionStats) {
+			top.emplace_back(stats.name, stats.calls, stats.totalNs);
+		}
+		count = std::min(count, top.size());
+		std::partial_sort(top.begin(), top.begin() + count, top.end(), [](const auto& a, const auto& b) {
+			return std::get<2>(a) > std::get<2>(b);
+		});
+		top.resize(count);
+		return top;
+	}
+
+	/**
+	 * @brief: 构建调用上下文树: 每条调用路径累计调用次数, 自身时间与自身分配字节
+	 *     memory 用于读取分配器的累计分配量, 为空时不统计分配
+	 *     每个 lua_State 有自己的调用栈, 协程中的调用挂在根节点下
+	 */
+	void EnableCallTree(const LuaMemoryTracker* memory) {
+		callTree = std::make_unique<CallTreeProfile>();
+		callTreeMemory = memory;
+		++callTreeGeneration;
+	}
+	void DisableCallTree() {
+		callTree.reset();
+	}
+	const CallTreeProfile* CallTree() const {
+		return callTree.get();
+	}
+	/* 取走调用树并关闭记录, 提交给 ProfileAggregator 时不需要复制 */
+	std::unique_ptr<CallTreeProfile> TakeCallTree() {
+		auto tree = std::move(callTree);
+		DisableCallTree();
+		return tree;
+	}
+
+	/* 每次运行从空的调用栈开始 */
+	void BeginRun() {
+		frameStacks.clear();
+		frameState = nullptr;
+		frameStack = nullptr;
+	}
+	/**
+	 * @brief: 错误传回宿主时被展开的帧收不到返回事件, 运行结束时以当前时间结束所有残留的帧,
+	 *     各个输出的调用/返回保持配对; 残留帧所属的协程可能已经被回收, 这里不再访问 lua_State
+	 */
+	void EndRun() {
+		if (frameStacks.empty()) {
+			return;
+		}
+		const auto now = TimeClock::now();
+		for (auto& [luaContext, stack] : frameStacks) {
+			frameState = luaContext;
+			frameStack = &stack;
+			CloseFrames(luaContext, INT_MIN, now, false);
+		}
+		BeginRun();
+	}
+
+	/**
+	 * @brief: 设置插桩过滤规则, 被过滤的函数不产生任何记录 (时间计入调用者)
+	 *     判定结果保存在符号缓存中 (按函数对象, Lua 与 C 函数相同, FFI 调用按调用点名字),
+	 *     每个函数只在第一次解析时判定一次; 更换规则时重新判定已缓存的符号
+	 */
+	void SetFilter(InstrumentFilter rules) {
+		filter = std::move(rules);
+		for (auto& [function, symbol] : symbols) {
+			symbol.bAccepted = filter.Empty() || filter.Accept(symbol.key.source, symbol.name);
+		}
+		for (auto& [name, symbol] : ffiSymbols) {
+			symbol.bAccepted = filter.Empty() || filter.Accept("=[C]", name);
+		}
+	}
+
+	/**
+	 * @brief: 符号缓存 (默认开启): 每个事件只用 lua_getinfo("f") 取函数对象的地址, 在缓存中查找函数名, 定义位置,
+	 *     标签与过滤结果; 每个函数对象第一次出现时才用 "nS" 完整解析一次
+	 *     函数名取第一次解析到的名字 (同一个函数在不同调用点的名字可能不同, 之后不再变化)
+	 *     函数对象被回收时由内存跟踪器的释放回调淘汰 (OnBlockFreed), 地址被新函数复用也不会认错
+	 *     关闭时每个事件都用 "nSl" 解析, 只用于对比测量
+	 */
+	void SetSymbolCache(bool bEnable) {
+		bSymbolCache = bEnable;
+		symbols.clear();
+	}
+	size_t CachedSymbols() const {
+		return symbols.size();
+	}
+	/**
+	 * @brief: FFI 调用 cdata 时钩子看到的是 cdata 元表中的 __call (所有 FFI 调用共用一个函数对象),
+	 *     记录为 FFI 类别, 按调用点的名字 (例如 ffi.C.sin 的 "sin") 区分, 每个名字一个符号
+	 *     __call 在脚本加载 ffi 之后才需要识别: 开启后, 钩子第一次解析 C 函数时检查 package.loaded.ffi,
+	 *     已经加载才取一次 __call (见 FindFfiCallFunction); 不会替脚本加载 ffi
+	 */
+	void EnableFfiDetection(bool bEnable) {
+		bFfiPending = bEnable;
+		ffiCallFunction = nullptr;
+		ffiCallees.clear();
+		ffiSymbols.clear();
+	}
+
+	/* LuaMemoryTracker::FreeCallback */
+	static void OnBlockFreed(void* context, void* ptr) {
+		auto* self = static_cast<LuaProfileReportor*>(context);
+		if (!self->symbols.empty()) {
+			self->symbols.erase(ptr);
+		}
+	}
+
+	/**
+	 * @brief: 设置钩子开销, 之后记录的时间扣除钩子本身的耗时
+	 *     一次调用的包含时间扣除 innerNs 与区间内每个后代调用的 perCallNs, 自身时间由包含时间减去
+	 *     (已扣除的) 子调用得到, 所以嵌套调用的开销逐层传递, 不会重复扣除
+	 */
+	void SetHookOverhead(const LuaHookOverhead& overhead) {
+		hookOverhead = overhead;
+	}
+	const LuaHookOverhead& HookOverhead() const {
+		return hookOverhead;
+	}
+
+	/* 是否有输出需要调用/返回事件; 没有时运行不安装调用/返回钩子 */
+	bool RecordsCalls() const {
+		return traceWriter || chromeTrace || callTree || bFunctionStats;
+	}
+
+	/* 送达报告器的调用/返回事件总数 (包括被过滤的), 两次读数之差即为期间的事件数 */
+	uint64_t HookEvents() const {
+		return hookEvents;
+	}
+
 	void LuaEventRecord(lua_State* luaContext, lua_Debug* ar) {
-		// 这里可以添加钩子逻辑，例如记录函数调用时间等
-		lua_getinfo(luaContext, "nSl", ar);	
-		auto name = ar->name ? ar->name : "unknown";
-		std::string info = std::format("Hooked function: {} at {}:{}", 
-			name, ar->short_src, ar->currentline);
-		if (ar->event == LUA_HOOKCALL){
-			luaCallStack.push({name, TimeClock::now()});
-			std::string time = GetTimeString(TimeClock::now());
-			std::string hint = std::format("Call function: {}, Time: {}", name, time);
-		} else if (ar->event == LUA_HOOKRET){
-			if (!luaCallStack.empty() && luaCallStack.top().first == name) {
-				auto [funcName, startTime] = luaCallStack.top();
-				luaCallStack.pop();
-				auto endTime = TimeClock::now();
-				auto duration = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-				std::string time = GetTimeString(endTime);
-				std::string hint = std::format("Return from function: {}, Time: {}, Duration: {} us", 
-					funcName, time, duration);
-			} else {
-				std::string time = GetTimeString(TimeClock::now());
-				std::string hint = std::format("Return from function: {}, Time: {}", name, time);
+		++hookEvents;
+		if (!RecordsCalls()) {
+			return;
+		}
+		lua_getinfo(luaContext, "f", ar);
+		const void* function = lua_topointer(luaContext, -1);
+		lua_pop(luaContext, 1);
+		FunctionSymbol& symbol = ResolveSymbol(luaContext, ar, function);
+		if (luaContext != frameState) {
+			frameState = luaContext;
+			frameStack = &frameStacks[luaContext];
+		}
+		/*
+		 * LuaJIT 不发送 LUA_HOOKTAILRET: 尾调用只有新函数的调用事件, 被替换的帧没有返回事件;
+		 * 错误展开的帧同样没有. 钩子 (以及 lua_getstack(L, 0)) 在 i_ci 中给出当前帧在 lua_State 栈中的位置,
+		 * 尾调用的新函数沿用被替换帧的位置, 所以任何事件都先结束位置不低于它的帧 (被过滤的函数也要做)
+		 */
+		const int level = ar->i_ci;
+		const bool bUnwind = !frameStack->empty() && frameStack->back().level >= level;
+		if (!symbol.bAccepted && !bUnwind) {
+			return;
+		}
+		auto now = TimeClock::now();
+		if (bUnwind) {
+			CloseFrames(luaContext, level, now, true);
+		}
+		if (!symbol.bAccepted) {
+			return;
+		}
+		if (ar->event == LUA_HOOKCALL) {
+			++recordedCalls;
+			OpenFrame(luaContext, symbol, level, now);
+		}
+	}
+private:
+	/* descendants: 计时区间内记录到的后代调用数 */
+	uint64_t CompensatedInclusiveNs(TimeClock::duration elapsed, uint64_t descendants) const {
+		const auto rawNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+		const uint64_t overheadNs = hookOverhead.innerNs + hookOverhead.perCallNs * descendants;
+		return rawNs > overheadNs ? rawNs - overheadNs : 0;
+	}
+
+	/* source 是虚拟机内部化的字符串, 函数存活期间指针不变 */
+	struct FunctionKey {
+		const char* source;
+		int lineDefined;
+		bool operator==(const FunctionKey&) const = default;
+	};
+	struct FunctionKeyHash {
+		size_t operator()(const FunctionKey& key) const {
+			return std::hash<const void*>{}(key.source) ^ (static_cast<size_t>(key.lineDefined) * 0x9e3779b97f4a7c15ull);
+		}
+	};
+	struct FunctionStats {
+		std::string name;
+		uint64_t calls {0};
+		uint64_t totalNs {0};
+	};
+	/* 一个函数对象解析一次的信息; 各输出的 ID 带上输出的代数, 重新开启输出后自动失效 */
+	struct FunctionSymbol {
+		std::string name;
+		std::string label;       /* "name (short_src:linedefined)", C 函数为 "name ([C])", FFI 调用为 "name ([FFI])" */
+		FunctionKey key;
+		FrameCategory category {FrameCategory::LUA};
+		bool bAccepted {true};
+		uint32_t traceId {0};
+		uint64_t traceGeneration {0};
+		uint32_t callTreeId {0};
+		uint64_t callTreeGeneration {0};
+		FunctionStats* stats {nullptr};   /* functionStats 中的统计项, 统计项不会被删除 */
+	};
+
+	/*
+	 * 一个已记录调用事件的帧; 各输出的代数为 0 表示压栈时该输出没有开启
+	 * 每个 lua_State 有自己的帧栈, 协程挂起时它的帧留在自己的栈上
+	 */
+	struct ActiveFrame {
+		int level {0};
+		TimePoint start {};
+		uint64_t callsAtEntry {0};
+		uint32_t traceId {0};
+		uint64_t traceGeneration {0};
+		uint64_t chromeGeneration {0};
+		uint32_t node {0};
+		uint64_t callTreeGeneration {0};
+		uint64_t childNs {0};
+		uint64_t allocStart {0};
+		uint64_t childAllocBytes {0};
+		FunctionStats* stats {nullptr};
+	};
+
+	FunctionSymbol& ResolveSymbol(lua_State* luaContext, lua_Debug* ar, const void* function) {
+		if (function && function == ffiCallFunction) {
+			return ResolveFfiSymbol(luaContext, ar);
+		}
+		if (bSymbolCache) {
+			auto it = symbols.find(function);
+			if (it != symbols.end()) {
+				return it->second;
+			}
+			lua_getinfo(luaContext, "nS", ar);
+			if (bFfiPending && DetectFfiCall(luaContext, ar, function)) {
+				return ResolveFfiSymbol(luaContext, ar);
+			}
+			return symbols.emplace(function, MakeSymbol(ar)).first->second;
+		}
+		lua_getinfo(luaContext, "nSl", ar);
+		if (bFfiPending && DetectFfiCall(luaContext, ar, function)) {
+			return ResolveFfiSymbol(luaContext, ar);
+		}
+		uncachedSymbol = MakeSymbol(ar);
+		return uncachedSymbol;
+	}
+	/* __call 是 C 函数, 符号缓存开启时每个 C 函数只在第一次解析时检查; 返回 function 是否就是 __call */
+	bool DetectFfiCall(lua_State* luaContext, const lua_Debug* ar, const void* function) {
+		if (!ar->what || std::string_view(ar->what) != "C") {
+			return false;
+		}
+		ffiCallFunction = FindFfiCallFunction(luaContext);
+		bFfiPending = ffiCallFunction == nullptr;
+		return function && function == ffiCallFunction;
+	}
+	/**
+	 * @brief: 取 cdata 元表中的 __call; ffi 还没有被加载 (package.loaded.ffi 为空) 时返回空指针
+	 *     用已加载的 ffi.new 创建一个 cdata 取它的元表, 只执行一次
+	 */
+	static const void* FindFfiCallFunction(lua_State* L) {
+		const void* function = nullptr;
+		const int top = lua_gettop(L);
+		lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+		if (lua_istable(L, -1)) {
+			lua_getfield(L, -1, "ffi");
+			if (lua_istable(L, -1)) {
+				lua_getfield(L, -1, "new");
+				lua_pushliteral(L, "int[1]");
+				if (lua_pcall(L, 1, 1, 0) == LUA_OK && lua_getmetatable(L, -1)) {
+					lua_getfield(L, -1, "__call");
+					if (lua_isfunction(L, -1)) {
+						function = lua_topointer(L, -1);
+					}
+				}
+			}
+		}
+		lua_settop(L, top);
+		return function;
+	}
+	/*
+	 * __call 的第一个参数是被调用的 cdata (例如 ffi.C.sin), 按 cdata 的地址缓存符号, 命中时不查询名字也不分配;
+	 * 缓存的 cdata 在注册表中保持引用 (直到 lua_close), 地址不会被别的 cdata 复用; 超过 FfiCalleeLimit 个之后按名字逐次查询
+	 */
+	FunctionSymbol& ResolveFfiSymbol(lua_State* luaContext, lua_Debug* ar) {
+		const void* callee = nullptr;
+		if (lua_getlocal(luaContext, ar, 1)) {
+			callee = lua_topointer(luaContext, -1);
+			auto cached = ffiCallees.find(callee);
+			if (cached != ffiCallees.end()) {
+				lua_pop(luaContext, 1);
+				return *cached->second;
+			}
+		}
+		lua_getinfo(luaContext, "n", ar);
+		FunctionSymbol& symbol = FfiSymbolNamed(ar->name ? ar->name : "unknown");
+		if (callee && ffiCallees.size() < FfiCalleeLimit) {
+			luaL_ref(luaContext, LUA_REGISTRYINDEX);
+			ffiCallees.emplace(callee, &symbol);
+		} else if (callee) {
+			lua_pop(luaContext, 1);
+		}
+		return symbol;
+	}
+	/* 同名调用点共用一个符号 */
+	FunctionSymbol& FfiSymbolNamed(std::string_view callName) {
+		std::string name(callName);
+		auto [it, bInserted] = ffiSymbols.try_emplace(name);
+		if (bInserted) {
+			FunctionSymbol& symbol = it->second;
+			symbol.name = name;
+			symbol.label = std::format("{} ([FFI])", name);
+			/* map 节点中的键地址不变, 作为函数统计的键 */
+			symbol.key = {it->first.c_str(), -1};
+			symbol.category = FrameCategory::FFI;
+			symbol.bAccepted = filter.Empty() || filter.Accept("=[C]", name);
+		}
+		return it->second;
+	}
+
+	FunctionSymbol MakeSymbol(const lua_Debug* ar) const {
+		FunctionSymbol symbol;
+		symbol.name = ar->name ? ar->name : "unknown";
+		symbol.key = {ar->source, ar->linedefined};
+		const std::string_view what = ar->what ? ar->what : "";
+		symbol.category = what == "C" ? FrameCategory::C : what == "main" ? FrameCategory::MAIN : FrameCategory::LUA;
+		symbol.label = symbol.category == FrameCategory::C
+			? std::format("{} ({})", symbol.name, ar->short_src)
+			: std::format("{} ({}:{})", symbol.name, ar->short_src, ar->linedefined);
+		symbol.bAccepted = filter.Empty() || filter.Accept(ar->source, symbol.name);
+		return symbol;
+	}
+
+	/* 调用事件: 各个输出记录调用并压入一帧, 帧中保存返回时需要的信息 */
+	void OpenFrame(lua_State* luaContext, FunctionSymbol& symbol, int level, TimePoint now) {
+		ActiveFrame frame {};
+		frame.level = level;
+		frame.start = now;
+		frame.callsAtEntry = recordedCalls;
+		if (traceWriter) {
+			if (symbol.traceGeneration != traceGeneration) {
+				symbol.traceId = traceWriter->InternString(symbol.label);
+				symbol.traceGeneration = traceGeneration;
+			}
+			frame.traceId = symbol.traceId;
+			frame.traceGeneration = traceGeneration;
+			RecordTraceEvent(luaContext, TraceRecordKind::CALL, symbol.traceId, now, true);
+		}
+		if (chromeTrace) {
+			frame.chromeGeneration = chromeGeneration;
+			RecordChromeEvent(luaContext, &symbol.label, now, true);
+		}
+		if (callTree) {
+			if (symbol.callTreeGeneration != callTreeGeneration) {
+				symbol.callTreeId = callTree->InternFunction(symbol.label);
+				symbol.callTreeGeneration = callTreeGeneration;
+			}
+			const bool bParent = !frameStack->empty() && frameStack->back().callTreeGeneration == callTreeGeneration;
+			frame.node = callTree->Child(bParent ? frameStack->back().node : CallTreeProfile::Root, symbol.callTreeId);
+			frame.allocStart = callTreeMemory ? callTreeMemory->TotalAllocatedBytes() : 0;
+			frame.callTreeGeneration = callTreeGeneration;
+		}
+		if (bFunctionStats) {
+			frame.stats = FunctionStatsOf(symbol);
+		}
+		frameStack->push_back(frame);
+	}
+
+	/* 结束当前栈上位置不低于 level 的帧; 帧只写入压栈时已经开启 (且之后没有重新开启) 的输出 */
+	void CloseFrames(lua_State* luaContext, int level, TimePoint now, bool bLive) {
+		while (!frameStack->empty() && frameStack->back().level >= level) {
+			const ActiveFrame frame = frameStack->back();
+			frameStack->pop_back();
+			if (traceWriter && frame.traceGeneration == traceGeneration) {
+				RecordTraceEvent(luaContext, TraceRecordKind::RETURN, frame.traceId, now, bLive);
+			}
+			if (chromeTrace && frame.chromeGeneration == chromeGeneration) {
+				RecordChromeEvent(luaContext, nullptr, now, bLive);
+			}
+			if (callTree && frame.callTreeGeneration == callTreeGeneration) {
+				RecordCallTreeReturn(frame, now);
+			}
+			if (bFunctionStats && frame.stats) {
+				frame.stats->calls++;
+				frame.stats->totalNs += CompensatedInclusiveNs(now - frame.start, recordedCalls - frame.callsAtEntry);
+			}
+		}
+	}
+
+	/* 协程切换时写一条 THREAD 记录; bSampleHeap 为 false 时 lua_State 可能已经无效, 不采样堆大小 */
+	void RecordTraceEvent(lua_State* luaContext, TraceRecordKind kind, uint32_t id, TimePoint now, bool bSampleHeap) {
+		auto timestamp = static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(now - traceStart).count());
+		if (luaContext != traceState) {
+			traceState = luaContext;
+			auto [it, bInserted] = traceThreads.try_emplace(luaContext, static_cast<uint32_t>(traceThreads.size()));
+			traceWriter->Record(TraceRecordKind::THREAD, it->second, timestamp);
+		}
+		traceWriter->Record(kind, id, timestamp);
+		if (bSampleHeap && timestamp - lastTraceHeapNs >= HeapSampleIntervalNs) {
+			lastTraceHeapNs = timestamp;
+			traceWriter->Record(TraceRecordKind::HEAP, static_cast<uint32_t>(HeapBytes(luaContext) / 1024), timestamp);
+		}
+	}
+
+	/*
+	 * label 不为空时开始一个切片, 为空时结束当前切片
+	 * 每个 lua_State 第一次出现时分配轨道: 主线程排在最前, 协程按出现顺序编号
+	 */
+	void RecordChromeEvent(lua_State* luaContext, const std::string* label, TimePoint now, bool bSampleHeap) {
+		auto timestamp = static_cast<uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(now - chromeStart).count());
+		if (luaContext != chromeState) {
+			chromeState = luaContext;
+			auto [it, bInserted] = chromeTracks.try_emplace(luaContext, static_cast<uint32_t>(chromeTracks.size() + 1));
+			if (bInserted) {
+				bool bMain = lua_pushthread(luaContext) == 1;
+				lua_pop(luaContext, 1);
+				chromeTrace->ThreadName(chromePid, it->second,
+					bMain ? std::string("main") : std::format("coroutine {}", it->second),
+					bMain ? 0 : static_cast<int64_t>(it->second));
+			}
+			chromeTid = it->second;
+		}
+		if (label) {
+			chromeTrace->Begin(chromePid, chromeTid, timestamp, *label);
+		} else {
+			chromeTrace->End(chromePid, chromeTid, timestamp);
+		}
+		/* 堆大小按固定间隔采样, 回收造成的下降在计数器轨道上直接可见 */
+		if (bSampleHeap && (lastHeapSampleNs == 0 || timestamp - lastHeapSampleNs >= HeapSampleIntervalNs)) {
+			lastHeapSampleNs = timestamp;
+			chromeTrace->Counter(chromePid, timestamp, "Lua heap", "KB",
+				static_cast<double>(HeapBytes(luaContext)) / 1024.0);
+		}
+	}
+
+	void RecordCallTreeReturn(const ActiveFrame& frame, TimePoint now) {
+		const uint64_t allocated = callTreeMemory ? callTreeMemory->TotalAllocatedBytes() : 0;
+		const uint64_t inclusive = CompensatedInclusiveNs(now - frame.start, recordedCalls - frame.callsAtEntry);
+		callTree->AddHookOverhead(hookOverhead.perCallNs);
+		callTree->RecordLatency(callTree->Nodes()[frame.node].function, inclusive);
+		const uint64_t allocBytes = allocated - frame.allocStart;
+		callTree->Add(frame.node, 1,
+			inclusive > frame.childNs ? inclusive - frame.childNs : 0,
+			allocBytes > frame.childAllocBytes ? allocBytes - frame.childAllocBytes : 0);
+		if (!frameStack->empty() && frameStack->back().callTreeGeneration == callTreeGeneration) {
+			frameStack->back().childNs += inclusive;
+			frameStack->back().childAllocBytes += allocBytes;
+		}
+	}
+
+	FunctionStats* FunctionStatsOf(FunctionSymbol& symbol) {
+		if (!symbol.stats) {
+			auto [it, bInserted] = functionStats.try_emplace(symbol.key);
+			if (bInserted) {
+				it->second.name = symbol.label;
 			}
+			symbol.stats = &it->second;
 		}
+		return symbol.stats;
+	}
+
+	static size_t HeapBytes(lua_State* luaContext) {
+		return static_cast<size_t>(lua_gc(luaContext, LUA_GCCOUNT, 0)) * 1024 +
+			static_cast<size_t>(lua_gc(luaContext, LUA_GCCOUNTB, 0));
 	}
+
 private:
-	std::stack<std::pair<std::string, TimePoint>> luaCallStack {};
+	InstrumentFilter filter {};
+	bool bSymbolCache {true};
+	std::unordered_map<const void*, FunctionSymbol> symbols {};
+	bool bFfiPending {false};
+	const void* ffiCallFunction {nullptr};
+	std::unordered_map<std::string, FunctionSymbol> ffiSymbols {};
+	static constexpr size_t FfiCalleeLimit = 4096;
+	std::unordered_map<const void*, FunctionSymbol*> ffiCallees {};
+	FunctionSymbol uncachedSymbol {};
+
+	LuaHookOverhead hookOverhead {};
+	uint64_t hookEvents {0};
+	/* 记录到的调用事件总数, 帧入栈时保存, 返回时相减即区间内的后代调用数 */
+	uint64_t recordedCalls {0};
+
+	bool bFunctionStats {false};
+	std::unordered_map<FunctionKey, FunctionStats, FunctionKeyHash> functionStats {};
+
+	std::unordered_map<lua_State*, std::vector<ActiveFrame>> frameStacks {};
+	lua_State* frameState {nullptr};
+	std::vector<ActiveFrame>* frameStack {nullptr};
+
+	std::unique_ptr<CallTreeProfile> callTree {nullptr};
+	const LuaMemoryTracker* callTreeMemory {nullptr};
+	uint64_t callTreeGeneration {0};
+
+	std::unique_ptr<TraceWriter> traceWriter {nullptr};
+	uint64_t traceGeneration {0};
+	TimePoint traceStart {};
+	lua_State* traceState {nullptr};
+	std::unordered_map<lua_State*, uint32_t> traceThreads {};
+	uint64_t lastTraceHeapNs {0};
+
+	/* 堆大小计数器的采样间隔 */
+	static constexpr uint64_t HeapSampleIntervalNs = 100 * 1000;
+	std::unique_ptr<ChromeTraceWriter> chromeTrace {nullptr};
+	uint64_t chromeGeneration {0};
+	TimePoint chromeStart {};
+	uint64_t chromePid {0};
+	uint64_t chromeTid {0};
+	lua_State* chromeState {nullptr};
+	std::unordered_map<lua_State*, uint32_t> chromeTracks {};
+	uint64_t lastHeapSampleNs {0};
+};
+
+/* 当前线程上正在运行的 LuaVM 的报告器, 钩子通过它分发事件 */
+inline thread_local LuaProfileReportor* activeReportor = nullptr;
 
+/**
+ * @brief: 单次运行的预算, 各项为 0 表示不限制
+ *     - 指令预算与截止时间由稀疏的 LUA_MASKCOUNT 钩子检查, 每 checkInterval 条字节码一次,
+ *       实际停止点最多超出 checkInterval 条指令
+ *     - 堆上限由跟踪分配器强制 (见 LuaMemoryTracker::SetHeapLimit)
+ *     LuaJIT 编译后的 trace 不执行计数钩子: 完全在 trace 中运行的循环只受堆上限约束,
+ *     离开 trace 回到解释器后才会再次检查指令数与时间
+ */
+struct LuaRunBudget {
+	uint64_t maxInstructions {0};
+	size_t maxHeapBytes {0};
+	std::chrono::nanoseconds deadline {0};
+	int checkInterval {10000};
+
+	bool IsActive() const {
+		return maxInstructions != 0 || maxHeapBytes != 0 || deadline.count() != 0;
+	}
+	bool NeedsCountHook() const {
+		return maxInstructions != 0 || deadline.count() != 0;
+	}
+};
+
+/* 一次运行中预算的检查状态, 由计数钩子访问 */
+struct LuaBudgetState {
+	using Clock = std::chrono::steady_clock;
+
+	LuaRunBudget budget {};
+	Clock::time_point deadline {};
+	uint64_t instructions {0};
+	const LuaMemoryTracker* memory {nullptr};
+	LuaAbortReason reason {LuaAbortReason::NONE};
+
+	/*
+	 * 超出预算后把钩子间隔改为 1: 脚本用 pcall 捕获了错误也会在下一条指令再次出错,
+	 * 错误最终一定传回宿主
+	 */
+	void OnCount(lua_State* L) {
+		instructions += static_cast<uint64_t>(budget.checkInterval);
+		if (reason == LuaAbortReason::NONE) {
+			if (budget.maxInstructions != 0 && instructions >= budget.maxInstructions) {
+				reason = LuaAbortReason::INSTRUCTIONS;
+			} else if (budget.deadline.count() != 0 && Clock::now() >= deadline) {
+				reason = LuaAbortReason::DEADLINE;
+			} else if (memory && memory->HeapLimitHit()) {
+				reason = LuaAbortReason::MEMORY;
+			} else {
+				return;
+			}
+			lua_sethook(L, lua_gethook(L), lua_gethookmask(L), 1);
+		}
+		luaL_error(L, "run aborted: %s budget exceeded", LuaAbortReasonName(reason));
+	}
 };
+inline thread_local LuaBudgetState* activeBudget = nullptr;
+
 struct LuaEntry{
 	std::string luaFileName{""};
 	std::string luaFuncName{""};
@@ -87,7 +729,87 @@ struct LuaEntry{
 inline static void PushLog(){}
 
 inline static void LuaHook(lua_State* L, lua_Debug* ar){
+	if (ar->event == LUA_HOOKCOUNT) {
+		if (activeBudget) {
+			activeBudget->OnCount(L);
+		}
+		return;
+	}
+	if (activeReportor) {
+		activeReportor->LuaEventRecord(L, ar);
+	}
+}
+
+/* 开关调用/返回钩子, 保留预算使用的计数钩子; 关闭后未被插桩的代码以完整的 JIT 速度运行 */
+inline static void SetCallHooks(lua_State* L, bool bEnable) {
+	int mask = lua_gethookmask(L) & ~(LUA_MASKCALL | LUA_MASKRET);
+	if (bEnable) {
+		mask |= LUA_MASKCALL | LUA_MASKRET;
+	}
+	lua_sethook(L, mask ? LuaHook : nullptr, mask, lua_gethookcount(L));
+}
 
+/* 开关钩子的 C 函数自身只能收到一半的事件, 补上另一半让各个记录保持配对 */
+inline static void RecordToggleEvent(lua_State* L, int event) {
+	lua_Debug ar {};
+	if (activeReportor && lua_getstack(L, 0, &ar)) {
+		ar.event = event;
+		activeReportor->LuaEventRecord(L, &ar);
+	}
+}
+
+/**
+ * @brief: 注册全局表 luaprofile, 脚本可以只在关心的区域内开启插桩
+ *     luaprofile.start() / luaprofile.stop() / luaprofile.enabled()
+ *     luaprofile.region(fn, ...): 在开启插桩的状态下调用 fn, 返回 fn 的返回值 (错误照常抛出)
+ *     区域开始时已经在栈上的函数收不到调用事件, 这些帧的返回事件被忽略
+ *     没有开启任何记录调用的输出时 start() 不安装钩子, enabled() 返回 false
+ */
+inline static void RegisterProfileApi(lua_State* L) {
+	lua_newtable(L);
+	lua_pushcfunction(L, [](lua_State* L) -> int {
+		if (activeReportor && activeReportor->RecordsCalls() && !(lua_gethookmask(L) & LUA_MASKCALL)) {
+			SetCallHooks(L, true);
+			RecordToggleEvent(L, LUA_HOOKCALL);
+		}
+		return 0;
+	});
+	lua_setfield(L, -2, "start");
+	lua_pushcfunction(L, [](lua_State* L) -> int {
+		if (lua_gethookmask(L) & LUA_MASKCALL) {
+			RecordToggleEvent(L, LUA_HOOKRET);
+			SetCallHooks(L, false);
+		}
+		return 0;
+	});
+	lua_setfield(L, -2, "stop");
+	lua_pushcfunction(L, [](lua_State* L) -> int {
+		lua_pushboolean(L, (lua_gethookmask(L) & LUA_MASKCALL) != 0);
+		return 1;
+	});
+	lua_setfield(L, -2, "enabled");
+	lua_setglobal(L, "luaprofile");
+
+	const char* region = R"(
+		local profile = luaprofile
+		local pack = function(...) return select("#", ...), { ... } end
+		profile.region = function(fn, ...)
+			local bWasEnabled = profile.enabled()
+			profile.start()
+			local n, results = pack(pcall(fn, ...))
+			if not bWasEnabled then
+				profile.stop()
+			end
+			if not results[1] then
+				error(results[2], 0)
+			end
+			return unpack(results, 2, n)
+		end
+	)";
+	if (luaL_dostring(L, region) != LUA_OK) {
+		LOG(Error, "Failed to set up luaprofile.region: {}", lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
 }
 
 inline static LuaEntry GetLuaEntry(const std::string& funcname) {
@@ -203,6 +925,99 @@ inline static std::filesystem::path FindLuaModule(
 	return "";
 }
 
+/**
+ * @brief: 进程内缓存工作空间的解析结果, 同一个工作空间反复创建 (短命的) 虚拟机时
+ *     不再重复检查目录, 拼接搜索路径, 递归查找入口模块和用正则检查入口函数
+ *     入口模块按文件修改时间校验, 文件被修改后重新检查
+ */
+class LuaWorkspaceCache {
+public:
+	struct Workspace {
+		bool bValid {false};
+		std::string packagePath {};   /* 追加到 package.path 的部分 */
+		std::string packageCPath {};  /* 追加到 package.cpath 的部分 */
+	};
+	struct Entry {
+		std::filesystem::path modulePath {};
+		std::filesystem::file_time_type writeTime {};
+		bool bFunctionFound {false};
+	};
+
+	static LuaWorkspaceCache& Instance() {
+		static LuaWorkspaceCache instance;
+		return instance;
+	}
+
+	Workspace GetWorkspace(const std::filesystem::path& workspace) {
+		const std::string key = workspace.string();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (auto it = workspaces.find(key); it != workspaces.end()) {
+				return it->second;
+			}
+		}
+		Workspace context {};
+		context.bValid = CheckPath(workspace);
+		context.packagePath =
+			key + "/?.lua;"    + // 单文件模块
+			key + "/?;"        + // 无扩展名模块
+			key + "/?/?.lua;"  + // 子目录模块
+			key + "/?/?;"      + // 子目录中无扩展名模块
+			key + "/?.luac";     // 预编译模块
+		context.packageCPath =
+			key + "/?.dll"      + // Windows
+			key + "/?.so"       + // Linux
+			key + "/loadall.dll"; // 通用加载器
+		/* 目录不存在时不缓存, 之后创建了目录还能重新检查 */
+		if (context.bValid) {
+			std::lock_guard<std::mutex> lock(mutex);
+			workspaces.emplace(key, context);
+		}
+		return context;
+	}
+
+	/* 找不到模块时 modulePath 为空 */
+	Entry GetEntry(const std::filesystem::path& workspace, const LuaEntry& entry) {
+		const std::string key = std::format("{}\n{}::{}", workspace.string(), entry.luaFileName, entry.luaFuncName);
+		std::error_code ec;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (auto it = entries.find(key); it != entries.end()) {
+				auto writeTime = std::filesystem::last_write_time(it->second.modulePath, ec);
+				if (!ec && writeTime == it->second.writeTime) {
+					return it->second;
+				}
+				entries.erase(it);
+			}
+		}
+		Entry context {};
+		context.modulePath = FindLuaModule(workspace, entry.luaFileName);
+		if (context.modulePath.empty()) {
+			return context;
+		}
+		context.writeTime = std::filesystem::last_write_time(context.modulePath, ec);
+		context.bFunctionFound = CheckLuaFunction(context.modulePath, entry.luaFuncName);
+		if (!ec) {
+			std::lock_guard<std::mutex> lock(mutex);
+			entries.emplace(key, context);
+		}
+		return context;
+	}
+
+	void Clear() {
+		std::lock_guard<std::mutex> lock(mutex);
+		workspaces.clear();
+		entries.clear();
+	}
+
+private:
+	LuaWorkspaceCache() = default;
+
+	std::mutex mutex {};
+	std::unordered_map<std::string, Workspace> workspaces {};
+	std::unordered_map<std::string, Entry> entries {};
+};
+
 class LuaVM{
 	struct LuaVMDeleter{
 		void operator()(lua_State* L) const {
@@ -217,6 +1032,35 @@ class LuaVM{
 	using LuaResultPtr = LuaResult*;
 	using TimeClock = std::chrono::high_resolution_clock;
 	using TimePoint = TimeClock::time_point;
+
+	/* Run 期间把本虚拟机的报告器设为当前线程的 activeReportor, 退出时恢复 */
+	struct ActiveReportorScope{
+		explicit ActiveReportorScope(LuaProfileReportor* reportor) : previous(activeReportor) {
+			activeReportor = reportor;
+		}
+		~ActiveReportorScope() {
+			activeReportor = previous;
+		}
+		LuaProfileReportor* previous;
+	};
+
+	/* Run 期间启用预算 (堆上限与计数钩子的状态), 任何返回路径上都恢复为不限制 */
+	struct ActiveBudgetScope{
+		ActiveBudgetScope(LuaBudgetState* state, LuaMemoryTracker* tracker) : previous(activeBudget), memory(tracker) {
+			activeBudget = state;
+			if (state && memory) {
+				memory->SetHeapLimit(state->budget.maxHeapBytes);
+			}
+		}
+		~ActiveBudgetScope() {
+			activeBudget = previous;
+			if (memory) {
+				memory->SetHeapLimit(0);
+			}
+		}
+		LuaBudgetState* previous;
+		LuaMemoryTracker* memory;
+	};
 public:
 	/* 
 	 * @function: 构造函数
@@ -230,10 +1074,373 @@ public:
 		InitEntryFunction(funcname);
 
 	}
+	/* 
+	 * @function: 构造函数, 只打开 libs 中列出的标准库 (见 LuaLibManifest)
+	*/
+	LuaVM(std::filesystem::path pathWorkspace, const std::string& funcname, const LuaLibManifest& libs) {
+		InitLuaVMContext(libs);
+		InitWorkSpace(pathWorkspace);
+		InitEntryFunction(funcname);
+	}
 	~LuaVM() = default;
 
 public:
+	/* 开启二进制 trace, 见 LuaProfileReportor::EnableBinaryTrace */
+	bool EnableBinaryTrace(const std::filesystem::path& path) {
+		return report.EnableBinaryTrace(path);
+	}
+	void DisableBinaryTrace() {
+		report.DisableBinaryTrace();
+	}
+	/* 开启时间线导出, 见 LuaProfileReportor::EnableChromeTrace */
+	bool EnableChromeTrace(const std::filesystem::path& path) {
+		return report.EnableChromeTrace(path);
+	}
+	void DisableChromeTrace() {
+		report.DisableChromeTrace();
+	}
+
+	/**
+	 * @brief: 把本虚拟机的日志同时写入 LoggerManager 中名为 name 的通道
+	 *     多个虚拟机可以在不同线程中写同一个通道, 行不会交错
+	 */
+	void AttachLogChannel(const std::string& name, LogMode mode=LogMode::ASYNC) {
+		logChannel = LoggerManager::Instance().Channel(name, mode);
+	}
+	/* 虚拟机内部日志保存在固定容量的环形缓冲区中, 超出部分覆盖最早的内容 */
+	std::string GetLog() const {
+		return luaVMlog.Str();
+	}
+	void SetLogCapacity(size_t bytes) {
+		luaVMlog = LogRingBuffer(bytes);
+	}
+	void DetachLogChannel() {
+		if (logChannel) {
+			logChannel->Flush();
+		}
+		logChannel.reset();
+	}
+
+	/**
+	 * @brief: 把每次 Run 的耗时, Lua 堆, GC 周期, JIT trace 数与热点函数发布到共享内存 /luaprofile.<name>
+	 *     用 `--top <name>` 查看; 发布按时间间隔节流, 热点函数来自钩子记录的函数统计 (EnableFunctionStats)
+	 */
+	bool EnableLiveMetrics(const std::string& name, const std::string& source = "LuaVM") {
+		auto publisher = std::make_shared<LiveMetricsPublisher>();
+		if (!publisher->Open(name)) {
+			__PushLog(publisher->ErrorMessage());
+			return false;
+		}
+		liveMetrics = std::make_unique<LiveMetricsRecorder>(publisher, luaVMContext.get(), source);
+		CalibrateHookOverhead();
+		report.EnableFunctionStats();
+		return true;
+	}
+	void DisableLiveMetrics() {
+		liveMetrics.reset();
+		report.EnableFunctionStats(false);
+	}
+
+	/**
+	 * @brief: 开启调用上下文树, 之后每次 Run 的调用累加到同一棵树中
+	 *     用 SaveCallTree 保存为折叠栈, 再用 --diff 与另一次运行比较 (见 CallTree.hpp)
+	 */
+	void EnableCallTree() {
+		CalibrateHookOverhead();
+		report.EnableCallTree(memoryTracker.get());
+	}
+	void DisableCallTree() {
+		report.DisableCallTree();
+	}
+	/* 未开启时返回空指针 */
+	const CallTreeProfile* CallTree() const {
+		return report.CallTree();
+	}
+	/* 取走调用树并关闭记录, 未开启时返回空指针 */
+	std::unique_ptr<CallTreeProfile> TakeCallTree() {
+		return report.TakeCallTree();
+	}
+	bool SaveCallTree(const std::filesystem::path& path) const {
+		const CallTreeProfile* tree = report.CallTree();
+		return tree && tree->SaveCollapsed(path);
+	}
+
+	/**
+	 * @brief: 标定钩子开销, 开启调用树或函数统计时自动执行, 结果按虚拟机缓存
+	 *     空函数循环分别在不开钩子与开钩子 (事件记录到临时的报告器) 时计时, 每次调用多出的时间即 perCallNs;
+	 *     临时调用树中空函数的自身时间减去空循环每次迭代的耗时即 innerNs
+	 *     标定函数关闭 JIT, 两次测量都在解释器中执行, 差值只包含钩子本身; 取多轮中的最小值
+	 */
+	const LuaHookOverhead& CalibrateHookOverhead() {
+		if (hookOverhead || !luaVMContext) {
+			return hookOverhead ? *hookOverhead : report.HookOverhead();
+		}
+		auto L = luaVMContext.get();
+		const char* calibration = "local function empty() end\n"
+			"return function(n) for i = 1, n do empty() end end";
+		if (luaL_loadstring(L, calibration) != LUA_OK) {
+			LOG(Error, "CalibrateHookOverhead failed: {}", lua_tostring(L, -1));
+			lua_pop(L, 1);
+			hookOverhead = LuaHookOverhead {};
+			return *hookOverhead;
+		}
+		/* 对整个 chunk 关闭 JIT: empty 与循环都是 chunk 的子函数, 只对返回的循环设置时 empty 仍会被编译 */
+		luaJIT_setmode(L, -1, LUAJIT_MODE_ALLFUNC | LUAJIT_MODE_OFF);
+		if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
+			LOG(Error, "CalibrateHookOverhead failed: {}", lua_tostring(L, -1));
+			lua_pop(L, 1);
+			hookOverhead = LuaHookOverhead {};
+			return *hookOverhead;
+		}
+		const int loopRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+		auto timeLoop = [&](bool bHooked) -> uint64_t {
+			lua_rawgeti(L, LUA_REGISTRYINDEX, loopRef);
+			lua_pushinteger(L, static_cast<lua_Integer>(CalibrationCalls));
+			if (bHooked) {
+				lua_sethook(L, LuaHook, LUA_MASKCALL | LUA_MASKRET, 0);
+			}
+			const auto start = TimeClock::now();
+			const int status = lua_pcall(L, 1, 0, 0);
+			const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(TimeClock::now() - start);
+			lua_sethook(L, nullptr, 0, 0);
+			if (status != LUA_OK) {
+				lua_pop(L, 1);
+			}
+			return static_cast<uint64_t>(elapsed.count());
+		};
+		LuaProfileReportor scratch;
+		scratch.EnableCallTree(nullptr);
+		uint64_t bareNs = UINT64_MAX;
+		uint64_t hookedNs = UINT64_MAX;
+		{
+			ActiveReportorScope reportorScope(&scratch);
+			for (int round = 0; round < CalibrationRounds; ++round) {
+				bareNs = std::min(bareNs, timeLoop(false));
+				hookedNs = std::min(hookedNs, timeLoop(true));
+			}
+		}
+		luaL_unref(L, LUA_REGISTRYINDEX, loopRef);
+
+		LuaHookOverhead overhead;
+		overhead.perCallNs = hookedNs > bareNs ? (hookedNs - bareNs) / CalibrationCalls : 0;
+		/* 空函数是调用次数最多的节点 */
+		uint64_t emptyCalls = 0;
+		uint64_t emptySelfNs = 0;
+		for (const auto& node : scratch.CallTree()->Nodes()) {
+			if (node.calls > emptyCalls) {
+				emptyCalls = node.calls;
+				emptySelfNs = node.selfNs;
+			}
+		}
+		if (emptyCalls > 0) {
+			const uint64_t selfPerCall = emptySelfNs / emptyCalls;
+			const uint64_t bodyPerCall = bareNs / CalibrationCalls;
+			overhead.innerNs = std::min(overhead.perCallNs, selfPerCall > bodyPerCall ? selfPerCall - bodyPerCall : 0);
+		}
+		LOG(Info, "Hook overhead: {} ns/call ({} ns inside the callee)", overhead.perCallNs, overhead.innerNs);
+		hookOverhead = overhead;
+		report.SetHookOverhead(overhead);
+		return *hookOverhead;
+	}
+
+	/**
+	 * @brief: 工作空间中的文件被修改后热重载, 虚拟机与未修改的模块保持预热状态
+	 *     - 入口文件被修改时丢弃缓存的 chunk, 下次 Run 重新编译
+	 *     - package.loaded 中由 package.searchpath 解析到被修改文件的模块被移除并重新 require,
+	 *       loadmodule 写入 _G 的同名全局变量一并替换
+	 *     - 重新 require 失败时恢复旧模块, 虚拟机依然可以运行旧版本
+	 *     其它模块已经持有的旧模块引用 (local m = require "x") 不会被替换
+	 * @param reloaded: 输出重新加载的模块名
+	 */
+	LuaResult ReloadModules(const std::vector<std::filesystem::path>& changed, std::vector<std::string>* reloaded = nullptr) {
+		if (!luaVMContext) {
+			return LuaResult(false, "Lua VM Context is not initialized");
+		}
+		auto canonical = [](const std::filesystem::path& path) {
+			std::error_code ec;
+			auto result = std::filesystem::weakly_canonical(path, ec);
+			return ec ? path : result;
+		};
+		std::vector<std::filesystem::path> changedFiles;
+		changedFiles.reserve(changed.size());
+		for (const auto& path : changed) {
+			changedFiles.push_back(canonical(path));
+		}
+		auto isChanged = [&](const std::filesystem::path& path) {
+			return std::find(changedFiles.begin(), changedFiles.end(), canonical(path)) != changedFiles.end();
+		};
+
+		auto L = luaVMContext.get();
+		if (entryChunkRef != LUA_NOREF && isChanged(luaEntryFile)) {
+			luaL_unref(L, LUA_REGISTRYINDEX, entryChunkRef);
+			entryChunkRef = LUA_NOREF;
+			__PushLog(std::format("Entry file changed, recompile on next run: {}", luaEntryFile.string()));
+		}
+
+		/* 先收集模块名, 遍历 package.loaded 时不能修改它 */
+		std::vector<std::string> modules;
+		const int top = lua_gettop(L);
+		lua_getglobal(L, "package");
+		lua_getfield(L, -1, "loaded");
+		lua_getfield(L, -2, "searchpath");
+		lua_getfield(L, -3, "path");
+		if (!lua_istable(L, -3) || !lua_isfunction(L, -2)) {
+			lua_settop(L, top);
+			return LuaResult(false, "package.loaded or package.searchpath not available");
+		}
+		const int loaded = top + 2, searchpath = top + 3, path = top + 4;
+		lua_pushnil(L);
+		while (lua_next(L, loaded) != 0) {
+			lua_pop(L, 1);
+			if (lua_type(L, -1) != LUA_TSTRING) {
+				continue;
+			}
+			lua_pushvalue(L, searchpath);
+			lua_pushvalue(L, -2);
+			lua_pushvalue(L, path);
+			if (lua_pcall(L, 2, 1, 0) == LUA_OK && lua_isstring(L, -1) && isChanged(lua_tostring(L, -1))) {
+				modules.emplace_back(lua_tostring(L, -2));
+			}
+			lua_pop(L, 1);
+		}
+
+		std::string errors;
+		for (const auto& name : modules) {
+			lua_getfield(L, loaded, name.c_str());
+			const int previous = lua_gettop(L);
+			lua_pushnil(L);
+			lua_setfield(L, loaded, name.c_str());
+			lua_getglobal(L, "require");
+			lua_pushstring(L, name.c_str());
+			if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+				errors += std::format("\n\treload '{}' failed: {}", name, lua_tostring(L, -1));
+				lua_pop(L, 1);
+				lua_pushvalue(L, previous);
+				lua_setfield(L, loaded, name.c_str());
+			} else {
+				lua_getglobal(L, name.c_str());
+				if (lua_rawequal(L, -1, previous)) {
+					lua_pushvalue(L, -2);
+					lua_setglobal(L, name.c_str());
+				}
+				lua_pop(L, 2);
+				if (reloaded) {
+					reloaded->push_back(name);
+				}
+			}
+			lua_settop(L, previous - 1);
+		}
+		lua_settop(L, top);
+
+		LuaResult ret(errors.empty(), errors.empty()
+			? std::format("Reloaded {} module(s)", modules.size())
+			: std::format("Reload failed:{}", errors));
+		__PushLog(&ret);
+		return ret;
+	}
+
+	/**
+	 * @brief: 设置之后每次 Run 的预算 (见 LuaRunBudget), 传入默认值取消限制
+	 *     超出预算的运行返回失败, abortReason 给出原因; 虚拟机可以继续运行
+	 */
+	void SetBudget(const LuaRunBudget& budget) {
+		runBudget = budget;
+		runBudget.checkInterval = std::max(1, runBudget.checkInterval);
+	}
+	const LuaRunBudget& Budget() const {
+		return runBudget;
+	}
+
+	/* 钩子事件的符号缓存, 默认开启; 关闭只用于对比测量 (见 LuaProfileReportor::SetSymbolCache) */
+	void SetSymbolCache(bool bEnable) {
+		report.SetSymbolCache(bEnable);
+	}
+	/* 钩子送达的调用/返回事件总数 (见 LuaProfileReportor::HookEvents) */
+	uint64_t HookEvents() const {
+		return report.HookEvents();
+	}
+
+	/* 插桩过滤规则, 见 InstrumentFilter; 传入空规则取消过滤 */
+	void SetInstrumentFilter(InstrumentFilter filter) {
+		report.SetFilter(std::move(filter));
+	}
+	/**
+	 * @brief: bEnable 为 false 时 Run 开始时不安装调用/返回钩子, 只记录脚本中
+	 *     luaprofile.start()/stop() (或 luaprofile.region) 之间的调用, 其余代码保持完整的 JIT 速度
+	 *     为 true (默认) 时也只在有输出记录调用时安装 (见 LuaProfileReportor::RecordsCalls);
+	 *     预算只安装计数钩子, 不需要调用/返回钩子
+	 */
+	void SetHookOnRun(bool bEnable) {
+		bHookOnRun = bEnable;
+	}
+	/* 立即开关调用/返回钩子, 可以在脚本调用的 C 函数中围绕关心的区域使用; 没有输出记录调用时不开启 */
+	void SetHooksEnabled(bool bEnable) {
+		if (luaVMContext) {
+			SetCallHooks(luaVMContext.get(), bEnable && report.RecordsCalls());
+		}
+	}
+
+	/* 以构造时指定的入口函数运行 */
+	LuaResult Run(const std::string& args) {
+		return Run(luaEntryFunc, args);
+	}
+
+	/* 虚拟机, 工作空间与入口文件都有效 */
+	bool IsValid() const {
+		return __Check();
+	}
+	const std::filesystem::path& EntryFile() const {
+		return luaEntryFile;
+	}
+	const std::string& EntryFunction() const {
+		return luaEntryFunc;
+	}
+	/* 构造时打开的标准库 */
+	const LuaLibManifest& Libs() const {
+		return luaLibs;
+	}
+
 	LuaResult Run(const std::string& funcname, const std::string& args) {
+		return RunTimed(funcname, [&args](lua_State* L) {
+			lua_pushlstring(L, args.c_str(), args.length());
+		});
+	}
+
+	/**
+	 * @brief: 以映射的文件作为入口函数的参数运行, 文件内容不会拷贝进 Lua
+	 *     入口函数收到的是 LuaMappedInput userdata (接口见 MappedInput.hpp)
+	 *     同一个 MappedFile 可以在多个虚拟机/多次运行之间共享
+	 */
+	LuaResult Run(const std::shared_ptr<MappedFile>& input) {
+		return Run(luaEntryFunc, input);
+	}
+	LuaResult Run(const std::string& funcname, const std::shared_ptr<MappedFile>& input) {
+		if (!input) {
+			return LuaResult(false, "Mapped input is null");
+		}
+		return RunTimed(funcname, [&input](lua_State* L) {
+			LuaMappedInput::Push(L, input);
+		});
+	}
+private:
+	using PushArgument = std::function<void(lua_State*)>;
+
+	LuaResult RunTimed(const std::string& funcname, const PushArgument& pushArgument) {
+		if (!liveMetrics) {
+			return RunOnce(funcname, pushArgument);
+		}
+		const auto start = TimeClock::now();
+		LuaResult ret = RunOnce(funcname, pushArgument);
+		const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(TimeClock::now() - start);
+		if (liveMetrics->RecordRun(static_cast<uint64_t>(elapsed.count()), ret.bSuccess)) {
+			liveMetrics->Publish(memoryTracker->CurrentHeapBytes(), memoryTracker->TotalGCCycles(),
+				report.TopFunctions(LiveMetricsHotFunctions));
+		}
+		return ret;
+	}
+
+	LuaResult RunOnce(const std::string& funcname, const PushArgument& pushArgument) {
 		if (!__Check()) { // Ensure Lua VM context and workspace are valid
 			LuaResult ret = LuaResult(
 				false,
@@ -242,49 +1449,114 @@ public:
 			return ret;
 		}
 		LuaResult ret {};
-		LuaProfileReportor report {};
 		auto luaVMptr = luaVMContext.get();
-		lua_sethook(luaVMptr, LuaHook, LUA_MASKCALL | LUA_MASKRET, 0);
-
-		int bRet = luaL_loadfile(luaVMptr, luaEntryFile.string().c_str());
-		if (bRet != LUA_OK) {
-			ret.bSuccess = false;
-			ret.msgError = std::format("Failed to load Lua file: {}, error: {}", 
-				luaEntryFile.string(), lua_tostring(luaVMptr, -1));
-			__PushLog(&ret, true);
-			return ret;
+		ActiveReportorScope reportorScope(&report);
+		report.BeginRun();
+		LuaBudgetState budgetState {};
+		const bool bBudget = runBudget.IsActive();
+		if (bBudget) {
+			budgetState.budget = runBudget;
+			budgetState.deadline = LuaBudgetState::Clock::now() + runBudget.deadline;
+			budgetState.memory = memoryTracker.get();
+		}
+		ActiveBudgetScope budgetScope(bBudget ? &budgetState : nullptr, memoryTracker.get());
+		/* 调用/返回钩子只在有输出需要时安装, 否则计时的是插桩后的脚本 */
+		ret.bCallHooks = bHookOnRun && report.RecordsCalls();
+		int hookMask = ret.bCallHooks ? (LUA_MASKCALL | LUA_MASKRET) : 0;
+		int hookCount = 0;
+		if (bBudget && runBudget.NeedsCountHook()) {
+			hookMask |= LUA_MASKCOUNT;
+			hookCount = runBudget.checkInterval;
+		}
+		lua_sethook(luaVMptr, hookMask ? LuaHook : nullptr, hookMask, hookCount);
+		memoryTracker->BeginRun();
+
+		/* 入口文件只编译一次, 之后的运行复用注册表中的 chunk */
+		int bRet = LUA_OK;
+		if (entryChunkRef == LUA_NOREF) {
+			bRet = luaL_loadfile(luaVMptr, luaEntryFile.string().c_str());
+			if (bRet != LUA_OK) {
+				ret.bSuccess = false;
+				ret.msgError = std::format("Failed to load Lua file: {}, error: {}", 
+					luaEntryFile.string(), lua_tostring(luaVMptr, -1));
+				lua_pop(luaVMptr, 1);
+				lua_sethook(luaVMptr, nullptr, 0, 0);
+				ret.luaMemory = memoryTracker->EndRun();
+				__PushLog(&ret, true);
+				return ret;
+			}
+			entryChunkRef = luaL_ref(luaVMptr, LUA_REGISTRYINDEX);
 		}
+		lua_rawgeti(luaVMptr, LUA_REGISTRYINDEX, entryChunkRef);
 		bRet = lua_pcall(luaVMptr, 0, 0, 0);
 		if (bRet != LUA_OK) {
 			ret.bSuccess = false;
 			ret.msgError = std::format("Failed to call Lua function: {}, error: {}", 
 				luaEntryFile.string(), lua_tostring(luaVMptr, -1));
+			lua_pop(luaVMptr, 1);
+			lua_sethook(luaVMptr, nullptr, 0, 0);
+			report.EndRun();
+			ret.luaMemory = memoryTracker->EndRun();
+			ApplyAbortReason(ret, budgetState);
 			__PushLog(&ret, true);
 			return ret;
 		}
 
 		// 执行入口函数
 		lua_getglobal(luaVMptr, funcname.c_str());
-		lua_pushlstring(luaVMptr, args.c_str(), args.length());
-		int luaRet = lua_pcall(luaVMptr, 1, 0, 0);
+		pushArgument(luaVMptr);
+		int luaRet = lua_pcall(luaVMptr, 1, 1, 0);
 		if (luaRet != LUA_OK) {
 			ret.bSuccess = false;
 			ret.msgError = std::format("Failed to call Lua function: {}, error: {}", 
 				luaEntryFile.string(), lua_tostring(luaVMptr, -1));
+			lua_pop(luaVMptr, 1);
+			lua_sethook(luaVMptr, nullptr, 0, 0);
+			report.EndRun();
+			ret.luaMemory = memoryTracker->EndRun();
+			ApplyAbortReason(ret, budgetState);
 			__PushLog(&ret, true);
 			return ret;
 		}
+		if (lua_isnumber(luaVMptr, -1)) {
+			ret.luaResult = lua_tonumber(luaVMptr, -1);
+		}
+		lua_pop(luaVMptr, 1);
 
 		lua_sethook(luaVMptr, nullptr, 0, 0);
+		report.EndRun();
+		ret.luaMemory = memoryTracker->EndRun();
+		ret.bSuccess = true;
 
 		// 输出统计和报错信息
 		return ret;
 	}
+
+	/*
+	 * 出错的运行如果是预算触发的 (包括堆上限导致的 "not enough memory"), 填写结构化的原因
+	 * 堆上限触发时附上完整回收后的堆大小: 小于上限说明失败的原因是还没有回收的垃圾, 需要调大上限留出余量
+	 */
+	void ApplyAbortReason(LuaResult& ret, const LuaBudgetState& budgetState) {
+		LuaAbortReason reason = budgetState.reason;
+		if (reason == LuaAbortReason::NONE && memoryTracker->HeapLimitHit()) {
+			reason = LuaAbortReason::MEMORY;
+		}
+		if (reason == LuaAbortReason::NONE) {
+			return;
+		}
+		ret.abortReason = reason;
+		const std::string liveHeap = reason == LuaAbortReason::MEMORY
+			? std::format(" live_after_gc={}", memoryTracker->CollectFullGarbage())
+			: "";
+		ret.msgError = std::format("aborted({}): instructions>={} heap_limit={}{} deadline_ms={}; {}",
+			LuaAbortReasonName(reason), budgetState.instructions, runBudget.maxHeapBytes, liveHeap,
+			std::chrono::duration_cast<std::chrono::milliseconds>(runBudget.deadline).count(), ret.msgError);
+	}
 private:
 	/** 
 	*	@brief: 初始化Lua执行的上下文, 创建Lua虚拟机 lua_State
 	*/
-	LuaResult InitLuaVMContext(){	
+	LuaResult InitLuaVMContext(const LuaLibManifest& libs = LuaLibManifest::All()){	
 		lua_State* L = luaL_newstate();
 		__PushLog("Init Lua VM Context:");	
 		if (!L){
@@ -296,7 +1568,13 @@ private:
 		}
 		luaVMContext = LuaVMInstancePtr(L);
 		/* 导入lua库 */
-		luaL_openlibs(luaVMContext.get());
+		libs.Open(luaVMContext.get());
+		luaLibs = libs;
+		/* 内存跟踪器必须先于 lua_close 析构, 见成员声明顺序 */
+		memoryTracker = std::make_unique<LuaMemoryTracker>(luaVMContext.get());
+		memoryTracker->SetFreeCallback(&LuaProfileReportor::OnBlockFreed, &report);
+		RegisterProfileApi(luaVMContext.get());
+		report.EnableFfiDetection(libs.Has(LuaLibManifest::FFI));
 
 		LuaResult ret {};
 		ret.bSuccess = true;
@@ -310,7 +1588,8 @@ private:
 	*/
 	LuaResult InitWorkSpace(std::filesystem::path path) {
 		__PushLog("Init Lua Work Space:");
-		if (!CheckPath(path))[[unlikely]]{
+		const LuaWorkspaceCache::Workspace context = LuaWorkspaceCache::Instance().GetWorkspace(path);
+		if (!context.bValid)[[unlikely]]{
 			LuaResult ret = LuaResult(
 				false,
 				std::format("Directory Error, path = {}", path.string())
@@ -346,12 +1625,7 @@ private:
 		LOG(Info, "current path is {}", root_path);
 		lua_pop(luaVMptr, 1);
 
-		std::string package_path = root_path + ";" + // 单文件模块
-			workspace.string() + "/?.lua;"    + // 无扩展名模块
-			workspace.string() + "/?;"        + // 子目录模块
-			workspace.string() + "/?/?.lua;"  + // 子目录模块
-			workspace.string() + "/?/?;"      + // 子目录中无扩展名模块
-			workspace.string() + "/?.luac";     // 预编译模块
+		std::string package_path = root_path + ";" + context.packagePath;
 
 		LOG(Info, "Lua package.path is {}", package_path);
 
@@ -364,10 +1638,7 @@ private:
 		std::string root_cpath = current_cpath ? current_cpath : "";
 		lua_pop(luaVMptr, 1);
 
-		std::string clib_path = root_cpath + ";" + 
-			workspace.string() + "/?.dll"      + // Windows
-			workspace.string() + "/?.so"       + // Linux
-			workspace.string() + "/loadall.dll"; // 通用加载器
+		std::string clib_path = root_cpath + ";" + context.packageCPath;
 
 		LOG(Info, "Lua package.path is {}", clib_path);
 
@@ -419,7 +1690,8 @@ private:
 			return ret;
 		}
 
-		std::filesystem::path modulePath = FindLuaModule(workspace, entry.luaFileName);
+		const LuaWorkspaceCache::Entry context = LuaWorkspaceCache::Instance().GetEntry(workspace, entry);
+		const std::filesystem::path& modulePath = context.modulePath;
 	
 		if(modulePath.empty()){
 			LuaResult ret(false, 
@@ -430,7 +1702,7 @@ private:
 		luaEntryFile = modulePath;
 		luaEntryFunc = entry.luaFuncName;
 		// 检查函数是否存在
-		if (!CheckLuaFunction(modulePath, entry.luaFuncName)) {
+		if (!context.bFunctionFound) {
 			LuaResult ret(false, 
 				std::format("Function '{}' not found in module '{}'", 
 						entry.luaFuncName, entry.luaFileName));
@@ -460,12 +1732,15 @@ private:
 	}
 	void __PushLog(LuaResult* ret, bool bIsChild=false, std::string extra="", int tabnum=1){
 		if (ret) {
-			__PushLog(ret->msgError, bIsChild, extra, tabnum);
+			__PushLog(ret->msgError, bIsChild, extra, tabnum, ret->bSuccess ? Level::INFO : Level::ERROR);
 		}
 	}
 
-	void __PushLog(std::string log="", bool bIsChild=false, std::string extra="", int tabnum=1){
+	void __PushLog(std::string log="", bool bIsChild=false, std::string extra="", int tabnum=1, Level level=Level::INFO){
 		if (log != "") {
+			if (logChannel) {
+				logChannel->Log(level, extra.empty() ? log : std::format("{} ({})", log, extra), Output::FILE);
+			}
 			if (bIsChild) {
 				int loop = tabnum < 1 ? 1 : tabnum;
 				for(int i=1; i<loop; ++i)
@@ -481,10 +1756,20 @@ private:
 private:
 	LuaProfileReportor report {};
 	LuaWorkspace workspace {};
+	LuaLibManifest luaLibs {};
+	LuaRunBudget runBudget {};
+	bool bHookOnRun {true};
+	std::optional<LuaHookOverhead> hookOverhead {std::nullopt};
+	static constexpr uint64_t CalibrationCalls = 20000;
+	static constexpr int CalibrationRounds = 5;
 	LuaVMInstancePtr luaVMContext {nullptr};
-	std::string luaVMlog {""};
+	std::unique_ptr<LuaMemoryTracker> memoryTracker {nullptr};
+	LogRingBuffer luaVMlog {64 * 1024};
+	std::shared_ptr<LogChannel> logChannel {nullptr};
+	std::unique_ptr<LiveMetricsRecorder> liveMetrics {nullptr};
 	std::filesystem::path luaEntryFile {""};
 	std::string luaEntryFunc {""};
+	int entryChunkRef {LUA_NOREF};
 	std::stack<std::pair<std::string, TimePoint>> luaCallStack {};
 };
 
@@ -493,13 +1778,15 @@ struct LuaVMResult {
 	bool bSuccess {false};
 	std::string ErrorMessage {};
 	double luaResult {0.0};
+	LuaMemoryStats memory {};
 };
 /*
   * @function: 运行 Lua 脚本并返回结果
   * @param path: Lua 脚本路径
+  * @param libs: 打开的标准库, 默认全部
   * @note:  该脚本必须有东西可以执行 
  */
-inline static LuaVMResult RunLuaScript(std::optional<std::string> path) {
+inline static LuaVMResult RunLuaScript(std::optional<std::string> path, const LuaLibManifest& libs = LuaLibManifest::All()) {
 	std::cout << "RunLuaScript: " << (path.has_value() ? path.value() : "null") << std::endl;
 	LuaVMResult result;
 	result.bSuccess = false; // 初始化为失败状态
@@ -517,7 +1804,9 @@ inline static LuaVMResult RunLuaScript(std::optional<std::string> path) {
         return result;
     }
 	/* 导入 Lua 库函数 */
-    luaL_openlibs(L);
+    libs.Open(L);
+    LuaMemoryTracker memoryTracker(L);
+    memoryTracker.BeginRun();
 
     std::string luaWorkspace = GetLuaWorkpace().value().string();
 
@@ -550,7 +1839,15 @@ inline static LuaVMResult RunLuaScript(std::optional<std::string> path) {
         printf("RunLuaScript Log:  LuaJIT error: %s\n", error);
         result.ErrorMessage = error ? error : "Unknown Lua error";
     }
-    
+
+    result.memory = memoryTracker.EndRun();
+    printf("RunLuaScript Log:  Lua heap peak: %zu KB, RSS delta: %lld KB, GC cycles: %llu full / %llu incremental, reclaimed: %llu KB\n",
+        result.memory.peakHeapBytes / 1024,
+        static_cast<long long>(result.memory.rssDeltaBytes / 1024),
+        static_cast<unsigned long long>(result.memory.fullGCCycles),
+        static_cast<unsigned long long>(result.memory.incrementalGCCycles),
+        static_cast<unsigned long long>(result.memory.reclaimedBytes / 1024));
+    memoryTracker.Detach();
     lua_close(L);
     return result;
 }
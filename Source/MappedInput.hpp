@@ -0,0 +1,217 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <new>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lua.hpp"
+}
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: 只读映射的输入文件, 多个虚拟机 (多个线程) 可以共享同一个映射
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile() {
+#ifndef _WIN32
+		if (mapped && mapped != MAP_FAILED) {
+			munmap(mapped, fileSize);
+		}
+#endif
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	 * @brief: 映射整个文件并提示内核按顺序预读
+	 * @return: 失败时返回空指针, error 中是原因
+	 */
+	static std::shared_ptr<MappedFile> Open(const std::filesystem::path& path, std::string& error) {
+#ifndef _WIN32
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			error = std::format("open {} failed: {}", path.string(), std::strerror(errno));
+			return nullptr;
+		}
+		struct stat st {};
+		if (fstat(fd, &st) != 0) {
+			error = std::format("fstat {} failed: {}", path.string(), std::strerror(errno));
+			::close(fd);
+			return nullptr;
+		}
+		auto file = std::make_shared<MappedFile>();
+		file->fileSize = static_cast<size_t>(st.st_size);
+		/* 空文件不能 mmap, 用空指针加长度 0 表示 */
+		if (file->fileSize > 0) {
+			file->mapped = mmap(nullptr, file->fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (file->mapped == MAP_FAILED) {
+				error = std::format("mmap {} failed: {}", path.string(), std::strerror(errno));
+				::close(fd);
+				return nullptr;
+			}
+			madvise(file->mapped, file->fileSize, MADV_SEQUENTIAL);
+		}
+		::close(fd);
+		return file;
+#else
+		error = std::format("mmap input is not supported on this platform: {}", path.string());
+		return nullptr;
+#endif
+	}
+
+	const uint8_t* Data() const {
+		return static_cast<const uint8_t*>(mapped);
+	}
+	size_t Size() const {
+		return fileSize;
+	}
+
+private:
+	void* mapped {nullptr};
+	size_t fileSize {0};
+};
+
+/**
+ * @brief: 把映射的文件作为 userdata 传给 Lua, 不拷贝文件内容
+ *     input:ptr()          lightuserdata, 用 ffi.cast("const uint8_t*", input:ptr()) 直接访问
+ *     input:size() / #input  字节数
+ *     input:sub(i [, j])   与 string.sub 相同的下标规则, 只拷贝这一段
+ *     input:chunks(n)      迭代器, 每次返回长度至多 n 的一段字符串 (只拷贝当前这一段)
+ *     input:views(n)       迭代器, 每次返回 (lightuserdata, 长度), 不拷贝
+ * userdata 持有映射的引用, 脚本保存它之后映射依然有效, 被回收时释放引用
+ */
+class LuaMappedInput {
+	static constexpr const char* Metatable = "LuaProfile.MappedInput";
+	using Handle = std::shared_ptr<MappedFile>;
+
+public:
+	static void Push(lua_State* L, std::shared_ptr<MappedFile> file) {
+		void* memory = lua_newuserdata(L, sizeof(Handle));
+		new (memory) Handle(std::move(file));
+		if (luaL_newmetatable(L, Metatable)) {
+			lua_pushcfunction(L, Gc);
+			lua_setfield(L, -2, "__gc");
+			lua_pushcfunction(L, Size);
+			lua_setfield(L, -2, "__len");
+			lua_newtable(L);
+			const luaL_Reg methods[] = {
+				{"ptr", Ptr},
+				{"size", Size},
+				{"sub", Sub},
+				{"chunks", Chunks},
+				{"views", Views},
+				{nullptr, nullptr}
+			};
+			for (const luaL_Reg* method = methods; method->name; ++method) {
+				lua_pushcfunction(L, method->func);
+				lua_setfield(L, -2, method->name);
+			}
+			lua_setfield(L, -2, "__index");
+		}
+		lua_setmetatable(L, -2);
+	}
+
+private:
+	static const MappedFile& Check(lua_State* L, int index) {
+		auto* handle = static_cast<Handle*>(luaL_checkudata(L, index, Metatable));
+		return **handle;
+	}
+
+	static int Gc(lua_State* L) {
+		auto* handle = static_cast<Handle*>(luaL_checkudata(L, 1, Metatable));
+		handle->~Handle();
+		return 0;
+	}
+
+	static int Ptr(lua_State* L) {
+		lua_pushlightuserdata(L, const_cast<uint8_t*>(Check(L, 1).Data()));
+		return 1;
+	}
+
+	static int Size(lua_State* L) {
+		lua_pushnumber(L, static_cast<lua_Number>(Check(L, 1).Size()));
+		return 1;
+	}
+
+	static int Sub(lua_State* L) {
+		const MappedFile& file = Check(L, 1);
+		const auto size = static_cast<lua_Number>(file.Size());
+		lua_Number i = luaL_checknumber(L, 2);
+		lua_Number j = luaL_optnumber(L, 3, -1);
+		if (i < 0) i = std::max<lua_Number>(size + i + 1, 1);
+		else if (i == 0) i = 1;
+		if (j < 0) j = size + j + 1;
+		else if (j > size) j = size;
+		if (i > j) {
+			lua_pushliteral(L, "");
+		} else {
+			lua_pushlstring(L, reinterpret_cast<const char*>(file.Data()) + static_cast<size_t>(i) - 1,
+				static_cast<size_t>(j - i + 1));
+		}
+		return 1;
+	}
+
+	/* 迭代器的上值: 1 = userdata, 2 = 块大小, 3 = 下一块的偏移 */
+	static int ChunkIterator(lua_State* L, bool bView) {
+		const MappedFile& file = Check(L, lua_upvalueindex(1));
+		const auto chunk = static_cast<size_t>(lua_tonumber(L, lua_upvalueindex(2)));
+		const auto offset = static_cast<size_t>(lua_tonumber(L, lua_upvalueindex(3)));
+		if (offset >= file.Size()) {
+			return 0;
+		}
+		const size_t len = std::min(chunk, file.Size() - offset);
+		lua_pushnumber(L, static_cast<lua_Number>(offset + len));
+		lua_replace(L, lua_upvalueindex(3));
+		const uint8_t* data = file.Data() + offset;
+		if (bView) {
+			lua_pushlightuserdata(L, const_cast<uint8_t*>(data));
+			lua_pushnumber(L, static_cast<lua_Number>(len));
+			return 2;
+		}
+		lua_pushlstring(L, reinterpret_cast<const char*>(data), len);
+		return 1;
+	}
+	static int NextChunk(lua_State* L) {
+		return ChunkIterator(L, false);
+	}
+	static int NextView(lua_State* L) {
+		return ChunkIterator(L, true);
+	}
+
+	static int MakeIterator(lua_State* L, lua_CFunction next) {
+		Check(L, 1);
+		lua_Number chunk = luaL_optnumber(L, 2, 1 << 20);
+		luaL_argcheck(L, chunk >= 1, 2, "chunk size must be positive");
+		lua_pushvalue(L, 1);
+		lua_pushnumber(L, chunk);
+		lua_pushnumber(L, 0);
+		lua_pushcclosure(L, next, 3);
+		return 1;
+	}
+	static int Chunks(lua_State* L) {
+		return MakeIterator(L, NextChunk);
+	}
+	static int Views(lua_State* L) {
+		return MakeIterator(L, NextView);
+	}
+};
+
+} // namespace LuaBenchmark
@@ -0,0 +1,268 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lua.hpp"
+}
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: 一次运行的内存占用统计
+ */
+struct LuaMemoryStats {
+	size_t peakHeapBytes {0};        /* 本次运行期间 Lua 堆的峰值 */
+	int64_t rssDeltaBytes {0};       /* 进程常驻内存 (RSS) 的变化量 */
+	uint64_t fullGCCycles {0};       /* collectgarbage("collect") 触发的完整回收次数 */
+	uint64_t incrementalGCCycles {0};/* 分步回收自然完成的周期数 */
+	uint64_t allocatedBytes {0};     /* 分配器累计分配的字节数 */
+	uint64_t reclaimedBytes {0};     /* 分配器累计释放 (即回收器回收) 的字节数 */
+};
+
+/**
+ * @brief: 读取 /proc/self/statm 中的常驻页数, 返回字节数; 非 Linux 或读取失败返回 0
+ */
+inline static int64_t GetResidentBytes() {
+#ifdef __linux__
+	std::ifstream statm("/proc/self/statm");
+	int64_t sizePages = 0;
+	int64_t residentPages = 0;
+	if (statm >> sizePages >> residentPages) {
+		return residentPages * static_cast<int64_t>(sysconf(_SC_PAGESIZE));
+	}
+#endif
+	return 0;
+}
+
+/**
+ * @brief: Lua 虚拟机的内存跟踪器
+ *     - 包装虚拟机原有的分配器, 精确统计堆峰值, 分配和释放字节数
+ *     - 放置一个带 __gc 的哨兵 userdata, 每完成一次 GC 周期被回收一次并重新放置, 以此计数
+ *     - 包装全局 collectgarbage, 区分显式的完整回收与分步回收
+ * @note: 必须在 lua_close 之前 Detach (析构时会自动 Detach)
+ */
+class LuaMemoryTracker {
+	struct GCCounters {
+		uint64_t cycles {0};
+		uint64_t fullCycles {0};
+		bool bStopped {false};
+	};
+	static constexpr const char* SentinelMetatable = "LuaProfile.GCSentinel";
+
+public:
+	explicit LuaMemoryTracker(lua_State* L) : luaState(L) {
+		if (!luaState) return;
+		originalAlloc = lua_getallocf(luaState, &originalUd);
+		currentBytes = static_cast<size_t>(lua_gc(luaState, LUA_GCCOUNT, 0)) * 1024 +
+			static_cast<size_t>(lua_gc(luaState, LUA_GCCOUNTB, 0));
+		peakBytes = currentBytes;
+		lua_setallocf(luaState, TrackingAlloc, this);
+
+		/* GC 计数器放在 Lua 堆中, 由哨兵的 __gc 闭包持有, 不依赖跟踪器的生命周期 */
+		counters = static_cast<GCCounters*>(lua_newuserdata(luaState, sizeof(GCCounters)));
+		*counters = GCCounters{};
+		luaL_newmetatable(luaState, SentinelMetatable);
+		lua_pushvalue(luaState, -2);
+		lua_pushcclosure(luaState, OnSentinelCollected, 1);
+		lua_setfield(luaState, -2, "__gc");
+		lua_pop(luaState, 1);
+		NewSentinel(luaState);
+
+		/* collectgarbage() / collectgarbage("collect") 记为一次完整回收 */
+		const char* wrapper = R"(
+			local onFullCollect = ...
+			local rawcollect = collectgarbage
+			collectgarbage = function(opt, ...)
+				if opt == nil or opt == "collect" then
+					onFullCollect()
+				end
+				return rawcollect(opt, ...)
+			end
+		)";
+		if (luaL_loadstring(luaState, wrapper) == LUA_OK) {
+			lua_pushvalue(luaState, -2);
+			lua_pushcclosure(luaState, OnFullCollect, 1);
+			if (lua_pcall(luaState, 1, 0, 0) != LUA_OK) {
+				lua_pop(luaState, 1);
+			}
+		} else {
+			lua_pop(luaState, 1);
+		}
+		/* 计数器 userdata 放入注册表, 保证 collectgarbage 被脚本替换后依然存活 */
+		lua_setfield(luaState, LUA_REGISTRYINDEX, "LuaProfile.GCCounters");
+		bAttached = true;
+	}
+	~LuaMemoryTracker() {
+		Detach();
+	}
+	LuaMemoryTracker(const LuaMemoryTracker&) = delete;
+	LuaMemoryTracker& operator=(const LuaMemoryTracker&) = delete;
+
+	/* 恢复原分配器并停止哨兵的重新放置, 必须在 lua_close 之前调用 */
+	void Detach() {
+		if (!bAttached) return;
+		counters->bStopped = true;
+		lua_setallocf(luaState, originalAlloc, originalUd);
+		bAttached = false;
+	}
+
+	/* 开始一次运行: 把峰值重置为当前堆大小, 记录各计数器的基线 */
+	void BeginRun() {
+		peakBytes = currentBytes;
+		baseAllocated = allocatedBytes;
+		baseReclaimed = reclaimedBytes;
+		baseCycles = counters ? counters->cycles : 0;
+		baseFullCycles = counters ? counters->fullCycles : 0;
+		baseResident = GetResidentBytes();
+	}
+
+	/* 结束一次运行, 返回相对 BeginRun 的增量 */
+	LuaMemoryStats EndRun() const {
+		LuaMemoryStats stats {};
+		stats.peakHeapBytes = peakBytes;
+		stats.rssDeltaBytes = GetResidentBytes() - baseResident;
+		stats.allocatedBytes = allocatedBytes - baseAllocated;
+		stats.reclaimedBytes = reclaimedBytes - baseReclaimed;
+		if (counters) {
+			uint64_t cycles = counters->cycles - baseCycles;
+			stats.fullGCCycles = counters->fullCycles - baseFullCycles;
+			stats.incrementalGCCycles = cycles > stats.fullGCCycles ? cycles - stats.fullGCCycles : 0;
+		}
+		return stats;
+	}
+
+	size_t CurrentHeapBytes() const {
+		return currentBytes;
+	}
+	/**
+	 * @brief: Lua 堆的上限 (字节), 0 表示不限制
+	 *     超过上限的分配 (只限增长, 释放与缩小总是成功) 直接返回空指针, Lua 抛出 "not enough memory",
+	 *     出错的运行被展开后虚拟机仍可继续使用
+	 *     上限包括还没有被回收的垃圾: 分配器中不能触发回收 (LuaJIT 分配失败时直接抛出错误, 没有紧急回收),
+	 *     增量回收落后时存活数据远小于上限也会失败, 上限需要比存活数据多留出一个 GC 周期的余量
+	 */
+	void SetHeapLimit(size_t bytes) {
+		heapLimit = bytes;
+		bHeapLimitHit = false;
+	}
+	bool HeapLimitHit() const {
+		return bHeapLimitHit;
+	}
+	/* 暂时取消上限做一次完整回收, 返回回收后的堆大小; 在运行结束后 (钩子与脚本之外) 调用 */
+	size_t CollectFullGarbage() {
+		const size_t limit = heapLimit;
+		heapLimit = 0;
+		lua_gc(luaState, LUA_GCCOLLECT, 0);
+		heapLimit = limit;
+		return currentBytes;
+	}
+
+	/**
+	 * @brief: 块被释放时回调 (ptr 为块地址), 符号缓存用它淘汰被回收的函数对象, 避免地址被新函数复用后认错
+	 *     未设置时释放路径上只多一次判空
+	 */
+	using FreeCallback = void (*)(void* context, void* ptr);
+	void SetFreeCallback(FreeCallback callback, void* context) {
+		freeCallback = callback;
+		freeContext = context;
+	}
+
+	/* 跟踪开始以来分配器累计分配的字节数, 两次读数之差即为期间的分配量 */
+	uint64_t TotalAllocatedBytes() const {
+		return allocatedBytes;
+	}
+	/* 跟踪开始以来完成的 GC 周期总数 */
+	uint64_t TotalGCCycles() const {
+		return counters ? counters->cycles : 0;
+	}
+
+private:
+	static void* TrackingAlloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+		auto* self = static_cast<LuaMemoryTracker*>(ud);
+		/* ptr 为空时 osize 没有意义 */
+		size_t oldSize = ptr ? osize : 0;
+		if (self->heapLimit != 0 && nsize > oldSize && self->currentBytes - oldSize + nsize > self->heapLimit) {
+			self->bHeapLimitHit = true;
+			return nullptr;
+		}
+		void* ret = self->originalAlloc(self->originalUd, ptr, osize, nsize);
+		if (nsize == 0) {
+			if (ptr && self->freeCallback) {
+				self->freeCallback(self->freeContext, ptr);
+			}
+			self->currentBytes -= oldSize;
+			self->reclaimedBytes += oldSize;
+			return ret;
+		}
+		if (!ret) {
+			return ret;
+		}
+		if (nsize > oldSize) {
+			self->allocatedBytes += nsize - oldSize;
+		} else {
+			self->reclaimedBytes += oldSize - nsize;
+		}
+		self->currentBytes = self->currentBytes - oldSize + nsize;
+		if (self->currentBytes > self->peakBytes) {
+			self->peakBytes = self->currentBytes;
+		}
+		return ret;
+	}
+
+	static void NewSentinel(lua_State* L) {
+		lua_newuserdata(L, 1);
+		luaL_getmetatable(L, SentinelMetatable);
+		lua_setmetatable(L, -2);
+		lua_pop(L, 1);
+	}
+
+	static int OnSentinelCollected(lua_State* L) {
+		auto* gc = static_cast<GCCounters*>(lua_touserdata(L, lua_upvalueindex(1)));
+		if (gc && !gc->bStopped) {
+			gc->cycles++;
+			NewSentinel(L);
+		}
+		return 0;
+	}
+
+	static int OnFullCollect(lua_State* L) {
+		auto* gc = static_cast<GCCounters*>(lua_touserdata(L, lua_upvalueindex(1)));
+		if (gc) {
+			gc->fullCycles++;
+		}
+		return 0;
+	}
+
+private:
+	lua_State* luaState {nullptr};
+	lua_Alloc originalAlloc {nullptr};
+	void* originalUd {nullptr};
+	GCCounters* counters {nullptr};
+	bool bAttached {false};
+
+	size_t currentBytes {0};
+	size_t peakBytes {0};
+	size_t heapLimit {0};
+	bool bHeapLimitHit {false};
+	FreeCallback freeCallback {nullptr};
+	void* freeContext {nullptr};
+	uint64_t allocatedBytes {0};
+	uint64_t reclaimedBytes {0};
+
+	uint64_t baseAllocated {0};
+	uint64_t baseReclaimed {0};
+	uint64_t baseCycles {0};
+	uint64_t baseFullCycles {0};
+	int64_t baseResident {0};
+};
+
+} // namespace LuaBenchmark
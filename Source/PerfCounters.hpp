@@ -0,0 +1,207 @@
+#pragma once
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <string>
+#include <string_view>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: 每个基准用例采集的硬件/软件性能计数器
+ */
+enum class PerfEvent : uint32_t {
+	CYCLES = 0,
+	INSTRUCTIONS,
+	L1D_MISSES,
+	LLC_MISSES,
+	BRANCH_MISSES,
+	CONTEXT_SWITCHES,
+	COUNT
+};
+inline constexpr size_t PerfEventCount = static_cast<size_t>(PerfEvent::COUNT);
+
+struct PerfCounterValues {
+	std::array<double, PerfEventCount> values {};
+	std::array<bool, PerfEventCount> valid {};
+
+	double Get(PerfEvent event) const {
+		return values[static_cast<size_t>(event)];
+	}
+	bool Has(PerfEvent event) const {
+		return valid[static_cast<size_t>(event)];
+	}
+	/* 每周期指令数, 两个计数器任一不可用时返回 0 */
+	double IPC() const {
+		if (!Has(PerfEvent::CYCLES) || !Has(PerfEvent::INSTRUCTIONS) || Get(PerfEvent::CYCLES) <= 0.0) {
+			return 0.0;
+		}
+		return Get(PerfEvent::INSTRUCTIONS) / Get(PerfEvent::CYCLES);
+	}
+};
+
+/**
+ * @brief: 基于 perf_event_open 的计数器组, 只统计调用线程
+ * @note: 每个事件单独打开, 某个事件不可用 (容器, perf_event_paranoid, 虚拟机没有 PMU)
+ *        不会影响其余事件; 全部不可用时 Available() 为 false, Start/Stop 为空操作
+ */
+class PerfCounters {
+public:
+	PerfCounters() {
+		fds.fill(-1);
+#ifdef __linux__
+		for (size_t i = 0; i < PerfEventCount; ++i) {
+			fds[i] = OpenEvent(static_cast<PerfEvent>(i));
+			if (fds[i] >= 0) {
+				totals.valid[i] = true;
+			} else if (unavailableReason.empty()) {
+				unavailableReason = std::format("{}: {}", Name(static_cast<PerfEvent>(i)), std::strerror(errno));
+			}
+		}
+#else
+		unavailableReason = "perf_event_open is only supported on Linux";
+#endif
+	}
+	~PerfCounters() {
+#ifdef __linux__
+		for (int fd : fds) {
+			if (fd >= 0) close(fd);
+		}
+#endif
+	}
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool Available() const {
+		for (bool v : totals.valid) {
+			if (v) return true;
+		}
+		return false;
+	}
+	bool Available(PerfEvent event) const {
+		return totals.Has(event);
+	}
+	/* 第一个打开失败的事件及原因, 用于提示为什么没有数据 */
+	const std::string& UnavailableReason() const {
+		return unavailableReason;
+	}
+
+	void Start() {
+#ifdef __linux__
+		for (int fd : fds) {
+			if (fd < 0) continue;
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	/* 停止计数并把本段的值 (按多路复用比例缩放后) 累加进 Totals() */
+	void Stop() {
+#ifdef __linux__
+		for (int fd : fds) {
+			if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+		for (size_t i = 0; i < PerfEventCount; ++i) {
+			if (fds[i] < 0) continue;
+			/* read_format: value, time_enabled, time_running */
+			uint64_t data[3] {};
+			if (read(fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) {
+				continue;
+			}
+			double value = static_cast<double>(data[0]);
+			if (data[2] > 0 && data[2] < data[1]) {
+				value *= static_cast<double>(data[1]) / static_cast<double>(data[2]);
+			}
+			totals.values[i] += value;
+		}
+#endif
+	}
+
+	void Reset() {
+		totals.values.fill(0.0);
+	}
+	const PerfCounterValues& Totals() const {
+		return totals;
+	}
+
+	static std::string_view Name(PerfEvent event) {
+		switch (event) {
+			case PerfEvent::CYCLES: return "Cycles";
+			case PerfEvent::INSTRUCTIONS: return "Instructions";
+			case PerfEvent::L1D_MISSES: return "L1DMisses";
+			case PerfEvent::LLC_MISSES: return "LLCMisses";
+			case PerfEvent::BRANCH_MISSES: return "BranchMisses";
+			case PerfEvent::CONTEXT_SWITCHES: return "CtxSwitches";
+			default: return "Unknown";
+		}
+	}
+
+private:
+#ifdef __linux__
+	static int OpenEvent(PerfEvent event) {
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.disabled = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		constexpr uint64_t cacheReadMiss =
+			(PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		switch (event) {
+			case PerfEvent::CYCLES:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_CPU_CYCLES;
+				break;
+			case PerfEvent::INSTRUCTIONS:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+				break;
+			case PerfEvent::L1D_MISSES:
+				attr.type = PERF_TYPE_HW_CACHE;
+				attr.config = PERF_COUNT_HW_CACHE_L1D | cacheReadMiss;
+				break;
+			case PerfEvent::LLC_MISSES:
+				attr.type = PERF_TYPE_HW_CACHE;
+				attr.config = PERF_COUNT_HW_CACHE_LL | cacheReadMiss;
+				break;
+			case PerfEvent::BRANCH_MISSES:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+				break;
+			case PerfEvent::CONTEXT_SWITCHES:
+				attr.type = PERF_TYPE_SOFTWARE;
+				attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+				break;
+			default:
+				errno = EINVAL;
+				return -1;
+		}
+
+		/* 上下文切换发生在内核态, 先尝试包含内核; perf_event_paranoid >= 2 时退回只统计用户态 */
+		if (attr.type == PERF_TYPE_SOFTWARE) {
+			int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+			if (fd >= 0) return fd;
+		}
+		attr.exclude_kernel = 1;
+		return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+	}
+#endif
+
+private:
+	std::array<int, PerfEventCount> fds {};
+	PerfCounterValues totals {};
+	std::string unavailableReason {""};
+};
+
+} // namespace LuaBenchmark
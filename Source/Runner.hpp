@@ -1,13 +1,61 @@
-
-#include <string>
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
 #include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+#include "LatencyHistogram.hpp"
 #include "LuaVM.hpp"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
 namespace LuaBenchmark {
 
+/* 默认的 Unix 域套接字路径 */
+inline constexpr const char* RunnerDefaultSocket = "/tmp/luaprofile.sock";
+
+/**
+ * @brief: 常驻的 Lua 虚拟机宿主, 按名字保存 LuaVM, 重复的 run 直接复用已经预热的虚拟机
+ *     命令按行输入 (stdin 或 Unix 域套接字), 每条命令恰好回复一行 "OK ..." 或 "ERR ...",
+ *     客户端可以一次写入多条命令再按顺序读取回复 (流水线)
+ *
+ * - create <name> <workspace> <module::function> [-l <库清单>] [-L <指标名>]: 新建一个Lua虚拟机, 默认打开全部标准库
+ *       -L 把主虚拟机 (run 的线程 0) 每次运行的耗时, 堆, GC 与热点函数发布到共享内存, 用 --top <指标名> 查看;
+ *       开启后每次运行都安装调用/返回钩子
+ * - destroy <name>: 关闭指定的lua虚拟机
+ * - run <name> [-r <次数>] [-j <线程数>] [-af <文件> | -a <参数, 取到行尾>]: 运行入口函数,
+ *       -j 大于 1 时次数分给多个线程, 每个线程使用自己的虚拟机副本
+ *       -af 把文件 mmap 一次, 所有线程与所有次数共享同一个映射 (见 MappedInput.hpp)
+ *       -I <指令数> -M <堆上限 MB> -T <截止时间 ms>: 每次运行的预算 (见 LuaRunBudget), 只对本条命令有效
+ *       -p <文件> 记录本次运行的调用上下文树, 所有线程合并后保存为折叠栈 (用 --diff 比较)
+ *       -f <规则> 插桩过滤 (见 InstrumentFilter), -R 只记录脚本 luaprofile.start()/stop() 之间的区域
+ *       -t <文件> 把调用/返回事件写成二进制 trace (用 LuaTraceDecoder 解码), 多个线程时
+ *           线程 i (i > 0) 写入 <文件名>.w<i><扩展名>
+ *       -C <文件> 把调用/返回写成 Chrome Trace Event JSON (用 Perfetto UI 打开), 多个线程时文件名同 -t
+ * - list: 查当前注册的所有lua虚拟机
+ * - ping: 连通性检查
+ * - shutdown: 退出服务
+ * - help: 帮助信息
+ */
 class Runner{
-	template <typename ...Args>
-	using runner = std::function<void(std::string, Args...)>;
 public:
 	static Runner& Instance(){
 		static Runner instance;
@@ -17,27 +65,562 @@ public:
 	Runner(const Runner&) = delete;
 	Runner& operator=(const Runner&) = delete;
 
-	/*
-	 * - file = "path::funcname"
-	 * - func = "path::funcname" arg1 arg2 ...
-	 * - "--start": 新建一个Lua虚拟机
-	 * - "--list": 查当前注册的所有lua虚拟机
-	 * - "--close id=1": 关闭指定id为1的lua虚拟机
-	 * - "--over": 关闭所有lua虚拟机
-	 * - "--help": 帮助信息
- 	*/
-	template<typename ...Args>
-	void parse(std::string argc, Args... args){
-		if (argc == ""){
+	/* 执行一条命令, 返回一行回复 (不含换行) */
+	std::string Execute(std::string_view line){
+		std::vector<std::string> tokens = Tokenize(line);
+		if (tokens.empty()) {
+			return "ERR empty command";
+		}
+		const std::string& command = tokens[0];
+		try {
+			if (command == "create") {
+				return Create(tokens);
+			} else if (command == "destroy") {
+				return Destroy(tokens);
+			} else if (command == "run") {
+				return RunVM(tokens, line);
+			} else if (command == "list") {
+				return List();
+			} else if (command == "ping") {
+				return "OK pong";
+			} else if (command == "shutdown") {
+				bShutdown = true;
+				return "OK bye";
+			} else if (command == "help") {
+				return "OK commands: create <name> <workspace> <module::function> [-l <libs>] [-L <metrics>] | destroy <name> | "
+					"run <name> [-r <n>] [-j <workers>] [-I <instructions>] [-M <heap_mb>] [-T <deadline_ms>] [-p <profile>] [-t <trace>] [-C <chrome.json>] [-f <filter>] [-R] [-af <file> | -a <args...>] | list | ping | shutdown";
+			}
+		} catch (const std::exception& e) {
+			return OneLine(std::format("ERR {}", e.what()));
+		}
+		return OneLine(std::format("ERR unknown command: {}", command));
+	}
+
+	bool ShutdownRequested() const {
+		return bShutdown;
+	}
+
+	/* 从输入流逐行读取命令, 每条回复立即写出 */
+	void ServeStream(std::istream& in, std::ostream& out){
+		std::string line;
+		while (!bShutdown && std::getline(in, line)) {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (line.empty()) {
+				continue;
+			}
+			out << Execute(line) << '\n' << std::flush;
+		}
+	}
 
+	/**
+	 * @brief: 在 Unix 域套接字上提供服务, 单线程 poll 处理所有连接
+	 *     每次读到的数据中所有完整的行依次执行, 回复攒在一起一次写回, 流水线的一批命令只需要一次往返
+	 */
+	int ServeUnixSocket(const std::string& path){
+#ifndef _WIN32
+		sockaddr_un addr {};
+		if (path.size() >= sizeof(addr.sun_path)) {
+			std::cerr << "Error: socket path too long: " << path << "\n";
+			return 1;
 		}
+		int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (listener < 0) {
+			std::cerr << "Error: socket failed: " << std::strerror(errno) << "\n";
+			return 1;
+		}
+		addr.sun_family = AF_UNIX;
+		std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+		::unlink(path.c_str());
+		if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+			std::cerr << std::format("Error: bind/listen {} failed: {}\n", path, std::strerror(errno));
+			::close(listener);
+			return 1;
+		}
+		std::cout << "Runner listening on " << path << std::endl;
+
+		struct Connection {
+			int fd;
+			std::string pending;
+		};
+		std::vector<Connection> connections;
+		std::vector<pollfd> fds;
+		char buffer[64 * 1024];
+		while (!bShutdown) {
+			fds.clear();
+			fds.push_back({listener, POLLIN, 0});
+			for (const auto& connection : connections) {
+				fds.push_back({connection.fd, POLLIN, 0});
+			}
+			if (poll(fds.data(), fds.size(), -1) < 0) {
+				if (errno == EINTR) continue;
+				std::cerr << "Error: poll failed: " << std::strerror(errno) << "\n";
+				break;
+			}
+			if (fds[0].revents & POLLIN) {
+				int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+				if (client >= 0) {
+					connections.push_back({client, ""});
+				}
+			}
+			for (size_t i = 1; i < fds.size(); ++i) {
+				if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+					continue;
+				}
+				Connection& connection = connections[i - 1];
+				ssize_t n = ::read(connection.fd, buffer, sizeof(buffer));
+				if (n <= 0) {
+					::close(connection.fd);
+					connection.fd = -1;
+					continue;
+				}
+				connection.pending.append(buffer, static_cast<size_t>(n));
+				std::string replies;
+				size_t start = 0;
+				for (size_t end; (end = connection.pending.find('\n', start)) != std::string::npos; start = end + 1) {
+					std::string_view line(connection.pending.data() + start, end - start);
+					if (!line.empty() && line.back() == '\r') {
+						line.remove_suffix(1);
+					}
+					if (line.empty()) {
+						continue;
+					}
+					replies += Execute(line);
+					replies += '\n';
+				}
+				connection.pending.erase(0, start);
+				if (!WriteAll(connection.fd, replies)) {
+					::close(connection.fd);
+					connection.fd = -1;
+				}
+			}
+			connections.erase(std::remove_if(connections.begin(), connections.end(),
+				[](const Connection& c) { return c.fd < 0; }), connections.end());
+		}
+		for (const auto& connection : connections) {
+			::close(connection.fd);
+		}
+		::close(listener);
+		::unlink(path.c_str());
+		return 0;
+#else
+		(void)path;
+		std::cerr << "Error: Unix domain sockets are not supported on this platform\n";
+		return 1;
+#endif
+	}
+
+	/**
+	 * @brief: 客户端: 一次写出全部命令, 再按顺序读回同样数量的回复
+	 * @return: 连接失败时为 std::nullopt
+	 */
+	static std::optional<std::vector<std::string>> Send(const std::string& path, const std::vector<std::string>& commands){
+#ifndef _WIN32
+		sockaddr_un addr {};
+		if (path.size() >= sizeof(addr.sun_path)) {
+			return std::nullopt;
+		}
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) {
+			return std::nullopt;
+		}
+		addr.sun_family = AF_UNIX;
+		std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+		if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+			::close(fd);
+			return std::nullopt;
+		}
+		std::string request;
+		for (const auto& command : commands) {
+			request += command;
+			request += '\n';
+		}
+		/* 边写边读: 大批量命令时服务端的回复可能先写满缓冲区, 不能等全部写完再读 */
+		std::vector<std::string> replies;
+		std::string_view unsent(request);
+		std::string pending;
+		char buffer[64 * 1024];
+		while (replies.size() < commands.size()) {
+			pollfd pfd {fd, static_cast<short>(POLLIN | (unsent.empty() ? 0 : POLLOUT)), 0};
+			if (poll(&pfd, 1, -1) < 0) {
+				if (errno == EINTR) continue;
+				break;
+			}
+			if (pfd.revents & POLLOUT) {
+				ssize_t n = ::send(fd, unsent.data(), unsent.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+				if (n < 0 && errno != EAGAIN && errno != EINTR) break;
+				if (n > 0) unsent.remove_prefix(static_cast<size_t>(n));
+			}
+			if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+				ssize_t n = ::read(fd, buffer, sizeof(buffer));
+				if (n < 0 && errno == EINTR) continue;
+				if (n <= 0) break;
+				pending.append(buffer, static_cast<size_t>(n));
+				size_t start = 0;
+				for (size_t end; (end = pending.find('\n', start)) != std::string::npos; start = end + 1) {
+					replies.emplace_back(pending, start, end - start);
+				}
+				pending.erase(0, start);
+			}
+		}
+		::close(fd);
+		return replies;
+#else
+		(void)path;
+		(void)commands;
+		return std::nullopt;
+#endif
 	}
 
-public:
-	
 private:
+	/* 命名的虚拟机; replicas 是并行运行时其他线程使用的副本, 第一次用到时创建, 之后保持预热 */
+	struct HostedVM {
+		std::unique_ptr<LuaVM> vm;
+		std::filesystem::path workspace;
+		std::string entry;
+		std::vector<std::unique_ptr<LuaVM>> replicas;
+		LuaLibManifest libs {};
+	};
+
+	/* 单个线程的运行记录 */
+	struct WorkerStats {
+		LatencyHistogram latency;
+		uint64_t busyNs {0};
+		LuaResult last {};
+		std::string error {""};
+	};
+
 	Runner() = default;
 
+	std::string Create(const std::vector<std::string>& tokens){
+		constexpr const char* usage = "ERR usage: create <name> <workspace> <module::function> [-l <lib,lib,...>] [-L <metrics>]";
+		if (tokens.size() < 4) {
+			return usage;
+		}
+		std::string manifest = "all";
+		std::string metricsName;
+		for (size_t i = 4; i < tokens.size(); ++i) {
+			if (tokens[i] == "-l" && i + 1 < tokens.size()) {
+				manifest = tokens[++i];
+			} else if (tokens[i] == "-L" && i + 1 < tokens.size()) {
+				metricsName = tokens[++i];
+			} else {
+				return usage;
+			}
+		}
+		const std::string& name = tokens[1];
+		if (luaVMs.contains(name)) {
+			return OneLine(std::format("ERR vm '{}' already exists", name));
+		}
+		std::string error;
+		auto libs = LuaLibManifest::Parse(manifest, error);
+		if (!libs.has_value()) {
+			return OneLine(std::format("ERR {}", error));
+		}
+		auto vm = std::make_unique<LuaVM>(tokens[2], tokens[3], libs.value());
+		if (!vm->IsValid()) {
+			return OneLine(std::format("ERR create '{}' failed: {}", name, vm->GetLog()));
+		}
+		if (!metricsName.empty() && !vm->EnableLiveMetrics(metricsName, name)) {
+			return OneLine(std::format("ERR live metrics '{}' failed: {}", metricsName, vm->GetLog()));
+		}
+		luaVMs.emplace(name, HostedVM{std::move(vm), tokens[2], tokens[3], {}, libs.value()});
+		return std::format("OK created {} libs={}{}", name, libs->ToString(),
+			metricsName.empty() ? "" : " metrics=" + metricsName);
+	}
+
+	std::string Destroy(const std::vector<std::string>& tokens){
+		if (tokens.size() != 2) {
+			return "ERR usage: destroy <name>";
+		}
+		if (luaVMs.erase(tokens[1]) == 0) {
+			return OneLine(std::format("ERR vm '{}' not found", tokens[1]));
+		}
+		return std::format("OK destroyed {}", tokens[1]);
+	}
+
+	std::string List() const {
+		std::vector<std::string> names;
+		names.reserve(luaVMs.size());
+		for (const auto& [name, hosted] : luaVMs) {
+			names.push_back(name);
+		}
+		std::sort(names.begin(), names.end());
+		std::string reply = std::format("OK {}", names.size());
+		for (const auto& name : names) {
+			reply += " " + name;
+		}
+		return reply;
+	}
+
+	/* -a 之后的原始文本 (保留空格) 作为参数传给入口函数, -af 则传入映射的文件 */
+	std::string RunVM(const std::vector<std::string>& tokens, std::string_view line){
+		if (tokens.size() < 2) {
+			return "ERR usage: run <name> [-r <n>] [-j <workers>] [-I <instructions>] [-M <heap_mb>] [-T <deadline_ms>] [-p <profile>] [-t <trace>] [-C <chrome.json>] [-f <filter>] [-R] [-af <file> | -a <args...>]";
+		}
+		auto it = luaVMs.find(tokens[1]);
+		if (it == luaVMs.end()) {
+			return OneLine(std::format("ERR vm '{}' not found", tokens[1]));
+		}
+		uint64_t repeat = 1;
+		size_t workers = 1;
+		std::string args;
+		std::shared_ptr<MappedFile> input;
+		std::string profilePath;
+		std::string tracePath;
+		std::string chromePath;
+		LuaRunBudget budget {};
+		InstrumentFilter filter {};
+		bool bRegionOnly = false;
+		for (size_t i = 2; i < tokens.size(); ++i) {
+			if (tokens[i] == "-f" && i + 1 < tokens.size()) {
+				std::string error;
+				auto parsed = InstrumentFilter::Parse(tokens[++i], error);
+				if (!parsed) {
+					return OneLine(std::format("ERR {}", error));
+				}
+				filter = std::move(*parsed);
+			} else if (tokens[i] == "-R") {
+				bRegionOnly = true;
+			} else if (tokens[i] == "-I" && i + 1 < tokens.size()) {
+				budget.maxInstructions = std::stoull(tokens[++i]);
+			} else if (tokens[i] == "-M" && i + 1 < tokens.size()) {
+				budget.maxHeapBytes = static_cast<size_t>(std::stoull(tokens[++i])) * 1024 * 1024;
+			} else if (tokens[i] == "-T" && i + 1 < tokens.size()) {
+				budget.deadline = std::chrono::milliseconds(std::stoll(tokens[++i]));
+			} else if (tokens[i] == "-p" && i + 1 < tokens.size()) {
+				profilePath = tokens[++i];
+			} else if (tokens[i] == "-t" && i + 1 < tokens.size()) {
+				tracePath = tokens[++i];
+			} else if (tokens[i] == "-C" && i + 1 < tokens.size()) {
+				chromePath = tokens[++i];
+			} else if (tokens[i] == "-af" && i + 1 < tokens.size()) {
+				std::string error;
+				input = MappedFile::Open(tokens[++i], error);
+				if (!input) {
+					return OneLine(std::format("ERR {}", error));
+				}
+			} else if (tokens[i] == "-r" && i + 1 < tokens.size()) {
+				repeat = std::max<uint64_t>(1, std::stoull(tokens[++i]));
+			} else if (tokens[i] == "-j" && i + 1 < tokens.size()) {
+				workers = std::clamp<size_t>(std::stoull(tokens[++i]), 1, 256);
+			} else if (tokens[i] == "-a") {
+				size_t pos = line.find(" -a");
+				if (pos != std::string_view::npos) {
+					std::string_view rest = line.substr(pos + 3);
+					if (!rest.empty() && rest.front() == ' ') rest.remove_prefix(1);
+					args = std::string(rest);
+				}
+				break;
+			} else {
+				return OneLine(std::format("ERR unknown run option: {}", tokens[i]));
+			}
+		}
+
+		workers = static_cast<size_t>(std::min<uint64_t>(workers, repeat));
+		HostedVM& hosted = it->second;
+		while (hosted.replicas.size() + 1 < workers) {
+			auto replica = std::make_unique<LuaVM>(hosted.workspace, hosted.entry, hosted.libs);
+			if (!replica->IsValid()) {
+				return OneLine(std::format("ERR create replica of '{}' failed: {}", tokens[1], replica->GetLog()));
+			}
+			hosted.replicas.push_back(std::move(replica));
+		}
+
+		auto workerVM = [&](size_t index) -> LuaVM& {
+			return index == 0 ? *hosted.vm : *hosted.replicas[index - 1];
+		};
+		if (!profilePath.empty()) {
+			for (size_t i = 0; i < workers; ++i) {
+				workerVM(i).EnableCallTree();
+			}
+		}
+		if (!tracePath.empty()) {
+			for (size_t i = 0; i < workers; ++i) {
+				if (!workerVM(i).EnableBinaryTrace(WorkerFilePath(tracePath, i))) {
+					for (size_t j = 0; j < i; ++j) {
+						workerVM(j).DisableBinaryTrace();
+					}
+					return OneLine(std::format("ERR open trace {} failed", WorkerFilePath(tracePath, i)));
+				}
+			}
+		}
+		if (!chromePath.empty()) {
+			for (size_t i = 0; i < workers; ++i) {
+				if (!workerVM(i).EnableChromeTrace(WorkerFilePath(chromePath, i))) {
+					for (size_t j = 0; j < workers; ++j) {
+						workerVM(j).DisableBinaryTrace();
+						workerVM(j).DisableChromeTrace();
+					}
+					return OneLine(std::format("ERR open chrome trace {} failed", WorkerFilePath(chromePath, i)));
+				}
+			}
+		}
+		for (size_t i = 0; i < workers; ++i) {
+			workerVM(i).SetBudget(budget);
+			workerVM(i).SetInstrumentFilter(filter);
+			workerVM(i).SetHookOnRun(!bRegionOnly);
+		}
+
+		/* 剩余次数用一个原子计数器动态领取, 快的线程多跑, 每个线程的次数与耗时反映不均衡 */
+		using Clock = std::chrono::steady_clock;
+		std::vector<WorkerStats> stats(workers);
+		std::atomic<uint64_t> nextRun {0};
+		std::atomic<bool> bFailed {false};
+		auto work = [&](size_t index) {
+			LuaVM& vm = workerVM(index);
+			WorkerStats& local = stats[index];
+			while (!bFailed.load(std::memory_order_relaxed) && nextRun.fetch_add(1, std::memory_order_relaxed) < repeat) {
+				auto start = Clock::now();
+				local.last = input ? vm.Run(input) : vm.Run(args);
+				auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+				if (!local.last.bSuccess) {
+					local.error = local.last.msgError;
+					bFailed.store(true);
+					return;
+				}
+				local.latency.Record(ns);
+				local.busyNs += ns;
+			}
+		};
+		const auto wallStart = Clock::now();
+		std::vector<std::thread> threads;
+		/* 每个线程跑完立即提交自己的调用树, 合并与仍在运行的线程重叠 */
+		ProfileAggregator profiles;
+		auto workAndSubmit = [&](size_t index) {
+			work(index);
+			if (!profilePath.empty()) {
+				profiles.Submit(workerVM(index).TakeCallTree());
+			}
+		};
+		threads.reserve(workers - 1);
+		for (size_t i = 1; i < workers; ++i) {
+			threads.emplace_back(workAndSubmit, i);
+		}
+		workAndSubmit(0);
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		const double wallNs = static_cast<double>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - wallStart).count());
+		/* 关闭 trace 文件, 写出剩余的记录 (Chrome trace 在关闭时补全 JSON 结尾) */
+		for (size_t i = 0; i < workers; ++i) {
+			if (!tracePath.empty()) {
+				workerVM(i).DisableBinaryTrace();
+			}
+			if (!chromePath.empty()) {
+				workerVM(i).DisableChromeTrace();
+			}
+		}
+
+		std::string profileReply;
+		if (!tracePath.empty()) {
+			profileReply += std::format(" trace={}{}", tracePath, workers > 1 ? std::format(" (+{} worker files)", workers - 1) : "");
+		}
+		if (!chromePath.empty()) {
+			profileReply += std::format(" chrome={}{}", chromePath, workers > 1 ? std::format(" (+{} worker files)", workers - 1) : "");
+		}
+		if (!profilePath.empty()) {
+			CallTreeProfile merged = profiles.Take();
+			if (!merged.SaveCollapsed(profilePath)) {
+				return OneLine(std::format("ERR save profile {} failed", profilePath));
+			}
+			profileReply += std::format(" profile={} hook_overhead={:.0f}ns/call self_split={}",
+				profilePath, merged.HookOverheadPerCallNs(), merged.CategorySplit());
+		}
+
+		for (size_t i = 0; i < workers; ++i) {
+			if (!stats[i].error.empty()) {
+				return OneLine(std::format("ERR run failed on worker {}: {}", i, stats[i].error));
+			}
+		}
+		/* 计时是否包含调用/返回钩子: on 整个运行, region 只在 luaprofile 区域内, off 没有插桩 */
+		const char* hooks = LastResult(stats).bCallHooks ? "on" : (bRegionOnly && !profilePath.empty()) ? "region" : "off";
+		return OneLine(FormatRunStats(stats, wallNs, hooks) + profileReply);
+	}
+
+	/* 每个线程一个输出文件: 线程 0 使用原路径, 其余在扩展名前加 .w<i> */
+	static std::string WorkerFilePath(const std::string& path, size_t index){
+		if (index == 0) {
+			return path;
+		}
+		std::filesystem::path file(path);
+		std::filesystem::path extension = file.extension();
+		return file.replace_extension().string() + std::format(".w{}", index) + extension.string();
+	}
+
+	/* 次数动态领取, 线程 0 可能一次也没跑到, 取第一个跑过的线程的最后结果 */
+	static const LuaResult& LastResult(const std::vector<WorkerStats>& stats){
+		for (const auto& worker : stats) {
+			if (worker.latency.Count() > 0) {
+				return worker.last;
+			}
+		}
+		return stats.front().last;
+	}
+
+	/* 合并所有线程的延迟直方图, 附带每个线程的明细 */
+	static std::string FormatRunStats(const std::vector<WorkerStats>& stats, double wallNs, std::string_view hooks){
+		LatencyHistogram merged;
+		for (const auto& worker : stats) {
+			merged.Merge(worker.latency);
+		}
+		const LuaResult& last = LastResult(stats);
+		std::string result = last.luaResult.has_value() ? std::format("{}", last.luaResult.value()) : "nil";
+		std::string reply = std::format(
+			"OK runs={} workers={} wall_ms={:.3f} throughput={:.1f}/s mean_us={:.3f} min_us={:.3f} "
+			"p50_us={:.3f} p90_us={:.3f} p99_us={:.3f} p999_us={:.3f} max_us={:.3f} hooks={} result={}",
+			merged.Count(), stats.size(), wallNs / 1e6,
+			wallNs > 0 ? static_cast<double>(merged.Count()) * 1e9 / wallNs : 0.0,
+			merged.Mean() / 1e3, merged.Min() / 1e3,
+			merged.Percentile(0.50) / 1e3, merged.Percentile(0.90) / 1e3, merged.Percentile(0.99) / 1e3,
+			merged.Percentile(0.999) / 1e3, merged.Max() / 1e3, hooks, result);
+		if (stats.size() > 1) {
+			for (size_t i = 0; i < stats.size(); ++i) {
+				const auto& latency = stats[i].latency;
+				reply += std::format(" | w{}: runs={} busy_ms={:.3f} mean_us={:.3f} p99_us={:.3f}",
+					i, latency.Count(), stats[i].busyNs / 1e6, latency.Mean() / 1e3, latency.Percentile(0.99) / 1e3);
+			}
+		}
+		return reply;
+	}
+
+	static std::vector<std::string> Tokenize(std::string_view line){
+		std::vector<std::string> tokens;
+		std::istringstream stream{std::string(line)};
+		std::string token;
+		while (stream >> token) {
+			tokens.push_back(token);
+		}
+		return tokens;
+	}
+
+	/* 回复必须是一行 */
+	static std::string OneLine(std::string text){
+		std::replace(text.begin(), text.end(), '\n', ' ');
+		std::replace(text.begin(), text.end(), '\r', ' ');
+		return text;
+	}
+
+#ifndef _WIN32
+	static bool WriteAll(int fd, std::string_view data){
+		while (!data.empty()) {
+			/* 对端已经关闭时返回错误而不是触发 SIGPIPE */
+			ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				return false;
+			}
+			data.remove_prefix(static_cast<size_t>(n));
+		}
+		return true;
+	}
+#endif
+
+private:
+	std::unordered_map<std::string, HostedVM> luaVMs;
+	bool bShutdown {false};
 };
 
-}
\ No newline at end of file
+}
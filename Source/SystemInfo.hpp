@@ -0,0 +1,228 @@
+#pragma once
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include "lauxlib.h"
+#include "lua.h"
+#include "lua.hpp"
+}
+
+#ifndef LUAPROFILE_BUILD_TYPE
+#define LUAPROFILE_BUILD_TYPE ""
+#endif
+#ifndef LUAPROFILE_CXX_FLAGS
+#define LUAPROFILE_CXX_FLAGS ""
+#endif
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: 读取单行文本文件 (sysfs/procfs), 失败返回空字符串
+ */
+inline static std::string ReadFirstLine(const std::string& path) {
+	std::ifstream file(path);
+	std::string line;
+	if (file) {
+		std::getline(file, line);
+	}
+	return line;
+}
+
+/**
+ * @brief: 把当前线程绑定到指定 CPU
+ * @return: 失败原因, 成功时为 std::nullopt
+ */
+inline static std::optional<std::string> PinCurrentThread(int cpu) {
+#ifdef __linux__
+	if (cpu < 0 || cpu >= CPU_SETSIZE) {
+		return std::format("cpu {} out of range", cpu);
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+		return std::format("sched_setaffinity(cpu {}) failed: {}", cpu, std::strerror(errno));
+	}
+	return std::nullopt;
+#else
+	return std::string("CPU pinning is only supported on Linux");
+#endif
+}
+
+/**
+ * @brief: 在权限允许的范围内提高当前线程的调度优先级
+ *     先尝试 nice -20, 没有 CAP_SYS_NICE 时逐级退回, 都失败则保持原优先级
+ * @return: 实际生效的 nice 值描述或失败原因
+ */
+inline static std::string RaiseCurrentThreadPriority() {
+#ifdef __linux__
+	const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+	errno = 0;
+	int current = getpriority(PRIO_PROCESS, tid);
+	if (errno != 0) {
+		return std::format("getpriority failed: {}", std::strerror(errno));
+	}
+	for (int nice = -20; nice < current; nice += 5) {
+		if (setpriority(PRIO_PROCESS, tid, nice) == 0) {
+			return std::format("nice {}", nice);
+		}
+	}
+	return std::format("nice {} (not permitted to raise: {})", current, std::strerror(errno));
+#else
+	return "unchanged (not supported on this platform)";
+#endif
+}
+
+/**
+ * @brief: 结果文件中记录的运行环境指纹, 用于跨机器比较结果
+ */
+struct EnvironmentFingerprint {
+	std::string cpuModel {"unknown"};
+	unsigned int cpuCount {0};
+	std::string governor {"unknown"};
+	std::string turbo {"unknown"};
+	std::string kernel {"unknown"};
+	std::string luajitVersion {"unknown"};
+	std::string jitStatus {"unknown"};
+	std::string buildFlags {""};
+	std::string pinnedCpu {"none"};
+	std::string priority {"unchanged"};
+
+	/* 调频策略不是 performance 或者 turbo 打开时, 结果容易抖动 */
+	std::vector<std::string> Warnings() const {
+		std::vector<std::string> warnings;
+		if (governor != "unknown" && governor != "performance") {
+			warnings.push_back(std::format("CPU governor is '{}', results may be affected by frequency scaling", governor));
+		}
+		if (turbo == "on") {
+			warnings.push_back("Turbo boost is enabled, results may vary with temperature and load");
+		}
+		return warnings;
+	}
+
+	std::vector<std::pair<std::string, std::string>> Fields() const {
+		return {
+			{"cpu_model", cpuModel},
+			{"cpu_count", std::to_string(cpuCount)},
+			{"cpu_governor", governor},
+			{"cpu_turbo", turbo},
+			{"kernel", kernel},
+			{"luajit_version", luajitVersion},
+			{"jit_status", jitStatus},
+			{"build_flags", buildFlags},
+			{"pinned_cpu", pinnedCpu},
+			{"priority", priority},
+		};
+	}
+};
+
+/**
+ * @brief: 采集 CPU 型号, 调频策略, turbo 状态, 内核版本, LuaJIT 版本/编译选项与 JIT 状态
+ * @param cpu: 绑定的 CPU, 用于读取该 CPU 的调频策略; 小于 0 时读取 cpu0
+ */
+inline static EnvironmentFingerprint CollectEnvironmentFingerprint(int cpu = -1) {
+	EnvironmentFingerprint info {};
+	info.cpuCount = std::thread::hardware_concurrency();
+#ifdef __linux__
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(cpuinfo, line)) {
+		if (line.rfind("model name", 0) == 0) {
+			auto pos = line.find(':');
+			if (pos != std::string::npos && pos + 2 <= line.size()) {
+				info.cpuModel = line.substr(pos + 2);
+			}
+			break;
+		}
+	}
+
+	const std::string cpuDir = std::format("/sys/devices/system/cpu/cpu{}/cpufreq/", cpu < 0 ? 0 : cpu);
+	std::string governor = ReadFirstLine(cpuDir + "scaling_governor");
+	if (!governor.empty()) {
+		info.governor = governor;
+	}
+	/* intel_pstate 用 no_turbo, acpi-cpufreq/amd 用 boost */
+	std::string noTurbo = ReadFirstLine("/sys/devices/system/cpu/intel_pstate/no_turbo");
+	std::string boost = ReadFirstLine("/sys/devices/system/cpu/cpufreq/boost");
+	if (!noTurbo.empty()) {
+		info.turbo = noTurbo == "0" ? "on" : "off";
+	} else if (!boost.empty()) {
+		info.turbo = boost == "1" ? "on" : "off";
+	}
+
+	utsname uts {};
+	if (uname(&uts) == 0) {
+		info.kernel = std::format("{} {} {}", uts.sysname, uts.release, uts.machine);
+	}
+#elif defined(_WIN32)
+	info.kernel = "Windows";
+#endif
+
+	/* 编译期信息: LuaJIT 头文件版本, 编译器与构建选项 */
+#ifdef LUAJIT_VERSION
+	info.luajitVersion = LUAJIT_VERSION;
+#endif
+#if defined(__clang__)
+	std::string compiler = std::format("clang {}", __clang_version__);
+#elif defined(__GNUC__)
+	std::string compiler = std::format("gcc {}", __VERSION__);
+#elif defined(_MSC_VER)
+	std::string compiler = std::format("msvc {}", _MSC_VER);
+#else
+	std::string compiler = "unknown";
+#endif
+#ifdef NDEBUG
+	constexpr const char* assertions = "NDEBUG";
+#else
+	constexpr const char* assertions = "assertions on";
+#endif
+	info.buildFlags = std::format("{}; build type '{}'; flags '{}'; {}",
+		compiler, LUAPROFILE_BUILD_TYPE, LUAPROFILE_CXX_FLAGS, assertions);
+
+	/* 运行期信息: jit.version, jit.status() 与 ffi.abi */
+	if (lua_State* L = luaL_newstate()) {
+		luaL_openlibs(L);
+		const char* probe = R"(
+			if not jit then
+				return "no jit", "off"
+			end
+			local status = { jit.status() }
+			status[1] = status[1] and "on" or "off"
+			local ok, ffi = pcall(require, "ffi")
+			if ok then
+				for _, abi in ipairs({ "64bit", "gc64", "fpu", "hardfp", "le" }) do
+					if ffi.abi(abi) then
+						status[#status + 1] = abi
+					end
+				end
+			end
+			return jit.version, table.concat(status, " ")
+		)";
+		if (luaL_dostring(L, probe) == LUA_OK) {
+			const char* version = lua_tostring(L, -2);
+			const char* status = lua_tostring(L, -1);
+			if (version) info.luajitVersion = version;
+			if (status) info.jitStatus = status;
+		}
+		lua_close(L);
+	}
+	return info;
+}
+
+} // namespace LuaBenchmark
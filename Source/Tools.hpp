@@ -5,24 +5,74 @@
 #include <string>
 #include <ctime>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <format>
+#include <string_view>
 #include <type_traits>
-#define INFO std::cout
-#define ERROR std::cerr
-#ifdef USELOG
-    #define LOG(ostream, fmt, ...) \
-        ostream << std::format(fmt, ##__VA_ARGS__) << "\n"
-
-    #define GETLOG(ostream, fmt, ...) \
-        ([&]() { \
-            std::string msg = std::format(fmt, ##__VA_ARGS__); \
-            ostream << msg << "\n"; \
-            return msg; \
-        })()
+#include <utility>
+
+/**
+ * @brief: 日志前端
+ *   LOG(Info, "x = {}", x)       级别: Debug, Info, Warning, Error (Error 写 stderr, 其余写 stdout)
+ *   GETLOG(Error, "...", ...)    同 LOG, 并返回本行文本 (std::string_view, 指向线程局部缓冲区,
+ *                                在本线程下一次写日志前有效); 被过滤时返回空
+ *   - 不定义 USELOG 时全部关闭; 否则最低级别由 LUAPROFILE_LOG_LEVEL (0-3) 指定,
+ *     默认 Debug 版本为 Debug, Release (NDEBUG) 版本为 Info
+ *   - 低于最低级别的调用在编译期被丢弃, 参数不会求值
+ *   - 格式串用 std::format_string 在编译期检查, 结果写入线程局部定长缓冲区, 不分配内存, 超长截断
+ */
+enum class LogSeverity : int {
+    Debug = 0,
+    Info,
+    Warning,
+    Error,
+    Off
+};
+
+#if !defined(USELOG)
+inline constexpr LogSeverity MinLogSeverity = LogSeverity::Off;
+#elif defined(LUAPROFILE_LOG_LEVEL)
+inline constexpr LogSeverity MinLogSeverity = static_cast<LogSeverity>(LUAPROFILE_LOG_LEVEL);
+#elif defined(NDEBUG)
+inline constexpr LogSeverity MinLogSeverity = LogSeverity::Info;
 #else
-    #define LOG(ostream, fmt, ...) (void)0
-    #define GETLOG(ostream, fmt, ...) (void)0
-#endif 
+inline constexpr LogSeverity MinLogSeverity = LogSeverity::Debug;
+#endif
+
+inline constexpr size_t LogBufferSize = 2048;
+
+template <LogSeverity Severity, typename... Args>
+inline std::string_view WriteLog(std::format_string<Args...> fmt, Args&&... args) {
+    thread_local char buffer[LogBufferSize];
+    /* 末尾留一个字节放换行 */
+    constexpr size_t capacity = LogBufferSize - 1;
+    auto result = std::format_to_n(buffer, capacity, fmt, std::forward<Args>(args)...);
+    size_t len = static_cast<size_t>(result.size);
+    if (len > capacity) {
+        len = capacity;
+        std::memcpy(buffer + capacity - 3, "...", 3);
+    }
+    buffer[len] = '\n';
+    std::fwrite(buffer, 1, len + 1, Severity >= LogSeverity::Error ? stderr : stdout);
+    return std::string_view(buffer, len);
+}
+
+#define LOG(level, fmt, ...) \
+    do { \
+        if constexpr (::LogSeverity::level >= ::MinLogSeverity) { \
+            ::WriteLog<::LogSeverity::level>(fmt, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define GETLOG(level, fmt, ...) \
+    ([&]() -> std::string_view { \
+        if constexpr (::LogSeverity::level >= ::MinLogSeverity) { \
+            return ::WriteLog<::LogSeverity::level>(fmt, ##__VA_ARGS__); \
+        } else { \
+            return {}; \
+        } \
+    })()
 
 inline static std::string GetTimeString(std::chrono::high_resolution_clock::time_point time) {
     // 获取与 system_clock 相同的 epoch 的 time_point
@@ -86,7 +136,7 @@ constexpr bool IsPointerVal =
     std::is_pointer<Pointer>::value || 
     IsSmartPtr<Pointer>::value;
 
-inline static std::optional<std::filesystem::path> GetLuaWorkpace(){
+inline static std::optional<std::filesystem::path> FindLuaWorkpace(){
     std::filesystem::path curPath = std::filesystem::current_path();
     std::filesystem::path luaPath {};
     std::cout << "Current path: " << curPath << std::endl;
@@ -108,6 +158,11 @@ inline static std::optional<std::filesystem::path> GetLuaWorkpace(){
     std::cout << "GetLuaWorkpace Log: Lua directory not found!" << std::endl;
     return std::nullopt;  // 如果都找不到，返回空
 }
+// 每个进程只查找一次 (进程启动后不再切换工作目录), 之后直接返回缓存的结果
+inline static const std::optional<std::filesystem::path>& GetLuaWorkpace(){
+    static const std::optional<std::filesystem::path> workspace = FindLuaWorkpace();
+    return workspace;
+}
 inline static std::optional<std::string> GetLuaCodePath(const std::string name){
     if (!GetLuaWorkpace().has_value()) {
         return std::nullopt;
@@ -0,0 +1,401 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: 二进制 trace 文件格式 (所有整数为本机字节序)
+ *
+ *   [TraceFileHeader, 占 TraceHeaderBytes]
+ *   [字符串表, stringCapacity 字节]   每项: varint id, varint 长度, 字节
+ *   [环形事件区, ringChunks 个块]     每块: TraceChunkHeader + 记录
+ *
+ *   记录: 1 字节 TraceRecordKind, varint id, varint 与上一条记录的时间差 (ns)
+ *   - CALL/RETURN 的 id 为字符串表中的函数名
+ *   - THREAD 的 id 为线程 (协程) 编号, 之后的记录都属于该线程
+ *   块是自包含的: 块头给出基准时间戳, 写入新块时会先重复当前线程的 THREAD 记录,
+ *   所以环形区回绕覆盖旧块后, 剩余的块依然可以独立解码
+ */
+enum class TraceRecordKind : uint8_t {
+	CALL = 1,
+	RETURN = 2,
+	THREAD = 3,
+	HEAP = 4     /* id 为 Lua 堆大小 (KB) */
+};
+
+inline constexpr char TraceMagic[8] = {'L', 'P', 'T', 'R', 'A', 'C', 'E', '1'};
+inline constexpr uint32_t TraceVersion = 1;
+inline constexpr size_t TraceHeaderBytes = 4096;
+/* 1 字节类型 + 两个最长 10 字节的 varint */
+inline constexpr size_t TraceMaxRecordBytes = 21;
+/* 读取端接受的最大字符串 id, 防止损坏的文件让名字表无限扩张 */
+inline constexpr uint64_t TraceMaxStringId = 1u << 22;
+
+/* 字符串表的键可以直接用 string_view 查找, 不构造临时 std::string */
+struct TraceStringHash {
+	using is_transparent = void;
+	size_t operator()(std::string_view str) const {
+		return std::hash<std::string_view>{}(str);
+	}
+};
+
+struct TraceFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t chunkSize;
+	uint64_t stringOffset;
+	uint64_t stringCapacity;
+	uint64_t stringUsed;
+	uint64_t ringOffset;
+	uint64_t ringChunks;
+	uint64_t nextChunkSeq;    /* 已经开始写的块数, 块 seq 存放在 seq % ringChunks */
+	uint64_t droppedStrings;  /* 字符串表写满后丢弃的名字数 */
+	uint64_t startUnixNs;     /* 打开文件时的系统时间, 事件时间戳相对于它 */
+};
+
+struct TraceChunkHeader {
+	uint64_t seq;
+	uint64_t baseTimestampNs;
+	uint32_t usedBytes;
+	uint32_t eventCount;
+};
+
+inline static size_t EncodeVarint(uint8_t* out, uint64_t value) {
+	size_t n = 0;
+	while (value >= 0x80) {
+		out[n++] = static_cast<uint8_t>(value) | 0x80;
+		value >>= 7;
+	}
+	out[n++] = static_cast<uint8_t>(value);
+	return n;
+}
+
+/* 解码失败 (越界或超过 10 字节) 返回 false */
+inline static bool DecodeVarint(const uint8_t*& cursor, const uint8_t* end, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && cursor < end; shift += 7) {
+		uint8_t byte = *cursor++;
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief: trace 写入端, 文件通过 mmap 映射, 记录时只做变长编码和一次 memcpy
+ * @note: 单线程使用; 同一个 Lua 虚拟机的钩子总是在同一个线程上触发
+ */
+class TraceWriter {
+public:
+	TraceWriter() = default;
+	~TraceWriter() {
+		Close();
+	}
+	TraceWriter(const TraceWriter&) = delete;
+	TraceWriter& operator=(const TraceWriter&) = delete;
+
+	/*
+	 * @param ringBytes: 环形事件区大小, 写满后覆盖最旧的块
+	 * @param chunkSize: 块大小, 也是回绕时一次丢弃的数据量
+	 * @param stringBytes: 字符串表大小
+	 */
+	bool Open(const std::filesystem::path& path, size_t ringBytes = 64 << 20,
+		size_t chunkSize = 64 << 10, size_t stringBytes = 4 << 20) {
+		Close();
+#ifdef _WIN32
+		errorMessage = "Binary trace requires mmap, not supported on Windows";
+		return false;
+#else
+		if (chunkSize <= sizeof(TraceChunkHeader) + 2 * TraceMaxRecordBytes || ringBytes < chunkSize) {
+			errorMessage = std::format("Invalid trace sizes: ring {} chunk {}", ringBytes, chunkSize);
+			return false;
+		}
+		const uint64_t ringChunks = ringBytes / chunkSize;
+		mappedBytes = TraceHeaderBytes + stringBytes + ringChunks * chunkSize;
+
+		fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0) {
+			errorMessage = std::format("Open trace file failed: {}: {}", path.string(), std::strerror(errno));
+			return false;
+		}
+		if (::ftruncate(fd, static_cast<off_t>(mappedBytes)) != 0) {
+			errorMessage = std::format("Resize trace file failed: {}", std::strerror(errno));
+			Close();
+			return false;
+		}
+		void* addr = ::mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			errorMessage = std::format("mmap trace file failed: {}", std::strerror(errno));
+			Close();
+			return false;
+		}
+		base = static_cast<uint8_t*>(addr);
+
+		header = reinterpret_cast<TraceFileHeader*>(base);
+		std::memcpy(header->magic, TraceMagic, sizeof(TraceMagic));
+		header->version = TraceVersion;
+		header->chunkSize = static_cast<uint32_t>(chunkSize);
+		header->stringOffset = TraceHeaderBytes;
+		header->stringCapacity = stringBytes;
+		header->stringUsed = 0;
+		header->ringOffset = TraceHeaderBytes + stringBytes;
+		header->ringChunks = ringChunks;
+		header->nextChunkSeq = 0;
+		header->droppedStrings = 0;
+		header->startUnixNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count());
+		return true;
+#endif
+	}
+
+	void Close() {
+#ifndef _WIN32
+		if (base) {
+			::msync(base, mappedBytes, MS_SYNC);
+			::munmap(base, mappedBytes);
+		}
+		if (fd >= 0) {
+			::close(fd);
+		}
+#endif
+		base = nullptr;
+		header = nullptr;
+		chunk = nullptr;
+		fd = -1;
+		strings.clear();
+		bHasThread = false;
+	}
+
+	bool IsOpen() const {
+		return base != nullptr;
+	}
+	const std::string& ErrorMessage() const {
+		return errorMessage;
+	}
+
+	/* 字符串第一次出现时写入字符串表, 之后直接返回 id */
+	uint32_t InternString(std::string_view str) {
+		auto it = strings.find(str);
+		if (it != strings.end()) {
+			return it->second;
+		}
+		const auto id = static_cast<uint32_t>(strings.size());
+		strings.emplace(std::string(str), id);
+
+		uint8_t prefix[20];
+		size_t prefixLen = EncodeVarint(prefix, id);
+		prefixLen += EncodeVarint(prefix + prefixLen, str.size());
+		if (header->stringUsed + prefixLen + str.size() > header->stringCapacity) {
+			header->droppedStrings++;
+			return id;
+		}
+		uint8_t* out = base + header->stringOffset + header->stringUsed;
+		std::memcpy(out, prefix, prefixLen);
+		std::memcpy(out + prefixLen, str.data(), str.size());
+		header->stringUsed += prefixLen + str.size();
+		return id;
+	}
+
+	/* 记录一个事件, timestampNs 为相对 Open 时刻的单调时间 */
+	void Record(TraceRecordKind kind, uint32_t id, uint64_t timestampNs) {
+		if (!base) [[unlikely]] {
+			return;
+		}
+		if (kind == TraceRecordKind::THREAD) {
+			bHasThread = true;
+			currentThread = id;
+		}
+		if (!chunk || chunkRemaining < TraceMaxRecordBytes) [[unlikely]] {
+			BeginChunk(timestampNs);
+			if (kind == TraceRecordKind::THREAD) {
+				/* BeginChunk 已经写入了这条 THREAD 记录 */
+				return;
+			}
+		}
+		Append(kind, id, timestampNs);
+	}
+
+private:
+	void BeginChunk(uint64_t timestampNs) {
+		const uint64_t seq = header->nextChunkSeq++;
+		chunk = base + header->ringOffset + (seq % header->ringChunks) * header->chunkSize;
+		auto* chunkHeader = reinterpret_cast<TraceChunkHeader*>(chunk);
+		chunkHeader->seq = seq;
+		chunkHeader->baseTimestampNs = timestampNs;
+		chunkHeader->usedBytes = 0;
+		chunkHeader->eventCount = 0;
+		chunkRemaining = header->chunkSize - sizeof(TraceChunkHeader);
+		lastTimestampNs = timestampNs;
+		if (bHasThread) {
+			Append(TraceRecordKind::THREAD, currentThread, timestampNs);
+		}
+	}
+
+	void Append(TraceRecordKind kind, uint32_t id, uint64_t timestampNs) {
+		uint8_t record[TraceMaxRecordBytes];
+		record[0] = static_cast<uint8_t>(kind);
+		size_t len = 1;
+		len += EncodeVarint(record + len, id);
+		len += EncodeVarint(record + len, timestampNs > lastTimestampNs ? timestampNs - lastTimestampNs : 0);
+		lastTimestampNs = std::max(lastTimestampNs, timestampNs);
+
+		auto* chunkHeader = reinterpret_cast<TraceChunkHeader*>(chunk);
+		std::memcpy(chunk + sizeof(TraceChunkHeader) + chunkHeader->usedBytes, record, len);
+		chunkHeader->usedBytes += static_cast<uint32_t>(len);
+		chunkHeader->eventCount++;
+		chunkRemaining -= len;
+	}
+
+private:
+	int fd {-1};
+	uint8_t* base {nullptr};
+	size_t mappedBytes {0};
+	TraceFileHeader* header {nullptr};
+	uint8_t* chunk {nullptr};
+	size_t chunkRemaining {0};
+	uint64_t lastTimestampNs {0};
+	bool bHasThread {false};
+	uint32_t currentThread {0};
+	std::unordered_map<std::string, uint32_t, TraceStringHash, std::equal_to<>> strings {};
+	std::string errorMessage {""};
+};
+
+struct TraceEvent {
+	TraceRecordKind kind {TraceRecordKind::CALL};
+	uint32_t thread {0};
+	uint32_t id {0};
+	uint64_t timestampNs {0};
+};
+
+/**
+ * @brief: trace 读取端, 供离线解码工具使用
+ */
+class TraceReader {
+public:
+	bool Open(const std::filesystem::path& path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			errorMessage = std::format("Open trace file failed: {}", path.string());
+			return false;
+		}
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		if (data.size() < TraceHeaderBytes) {
+			errorMessage = "Trace file is truncated";
+			return false;
+		}
+		std::memcpy(&header, data.data(), sizeof(header));
+		if (std::memcmp(header.magic, TraceMagic, sizeof(TraceMagic)) != 0 || header.version != TraceVersion) {
+			errorMessage = "Not a LuaProfile binary trace (bad magic or version)";
+			return false;
+		}
+		if (header.ringOffset + header.ringChunks * header.chunkSize > data.size() ||
+			header.stringOffset + header.stringUsed > data.size()) {
+			errorMessage = "Trace file is truncated";
+			return false;
+		}
+
+		const uint8_t* cursor = Bytes() + header.stringOffset;
+		const uint8_t* end = cursor + header.stringUsed;
+		while (cursor < end) {
+			uint64_t id = 0;
+			uint64_t len = 0;
+			if (!DecodeVarint(cursor, end, id) || !DecodeVarint(cursor, end, len) ||
+				len > static_cast<uint64_t>(end - cursor)) {
+				errorMessage = "Corrupted string table";
+				return false;
+			}
+			/* 写入端按顺序分配 id, 只有写满时丢弃的名字会留下空位, 因此 id 递增且最多跳过 droppedStrings 个 */
+			if (id < names.size() || id > names.size() + header.droppedStrings || id >= TraceMaxStringId) {
+				errorMessage = std::format("Corrupted string table (string id {})", id);
+				return false;
+			}
+			names.resize(id + 1);
+			names[id].assign(reinterpret_cast<const char*>(cursor), len);
+			cursor += len;
+		}
+		return true;
+	}
+
+	const std::string& ErrorMessage() const {
+		return errorMessage;
+	}
+	const TraceFileHeader& Header() const {
+		return header;
+	}
+
+	std::string Name(uint32_t id) const {
+		if (id < names.size() && !names[id].empty()) {
+			return names[id];
+		}
+		return std::format("#{}", id);
+	}
+
+	/* 按块的写入顺序遍历仍在环形区中的所有事件 */
+	template <typename Fn>
+	void ForEachEvent(Fn&& fn) const {
+		const uint64_t lastSeq = header.nextChunkSeq;
+		const uint64_t firstSeq = lastSeq > header.ringChunks ? lastSeq - header.ringChunks : 0;
+		for (uint64_t seq = firstSeq; seq < lastSeq; ++seq) {
+			const uint8_t* chunk = Bytes() + header.ringOffset + (seq % header.ringChunks) * header.chunkSize;
+			TraceChunkHeader chunkHeader;
+			std::memcpy(&chunkHeader, chunk, sizeof(chunkHeader));
+			if (chunkHeader.seq != seq ||
+				chunkHeader.usedBytes > header.chunkSize - sizeof(TraceChunkHeader)) {
+				continue;
+			}
+			const uint8_t* cursor = chunk + sizeof(TraceChunkHeader);
+			const uint8_t* end = cursor + chunkHeader.usedBytes;
+			TraceEvent event {};
+			event.timestampNs = chunkHeader.baseTimestampNs;
+			while (cursor < end) {
+				auto kind = static_cast<TraceRecordKind>(*cursor++);
+				uint64_t id = 0;
+				uint64_t delta = 0;
+				if (!DecodeVarint(cursor, end, id) || !DecodeVarint(cursor, end, delta)) {
+					break;
+				}
+				event.timestampNs += delta;
+				if (kind == TraceRecordKind::THREAD) {
+					event.thread = static_cast<uint32_t>(id);
+					continue;
+				}
+				event.kind = kind;
+				event.id = static_cast<uint32_t>(id);
+				fn(static_cast<const TraceEvent&>(event));
+			}
+		}
+	}
+
+private:
+	const uint8_t* Bytes() const {
+		return reinterpret_cast<const uint8_t*>(data.data());
+	}
+
+	std::vector<char> data {};
+	TraceFileHeader header {};
+	std::vector<std::string> names {};
+	std::string errorMessage {""};
+};
+
+} // namespace LuaBenchmark
@@ -0,0 +1,327 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "LatencyHistogram.hpp"
+#include "LuaVM.hpp"
+
+namespace LuaBenchmark {
+
+/**
+ * @brief: 监视工作空间中 Lua 源文件的修改
+ *     Linux 上使用 inotify (递归监视所有子目录, 新建的子目录自动加入),
+ *     其它平台退化为按修改时间轮询
+ *     编辑器保存时通常会产生一串事件 (写临时文件, 重命名), Wait 在第一个事件之后
+ *     等到 settle 时间内不再有新事件才返回, 同一个文件只报告一次
+ */
+class WorkspaceWatcher {
+public:
+	WorkspaceWatcher() = default;
+	~WorkspaceWatcher() {
+#ifdef __linux__
+		if (inotifyFd >= 0) {
+			::close(inotifyFd);
+		}
+#endif
+	}
+	WorkspaceWatcher(const WorkspaceWatcher&) = delete;
+	WorkspaceWatcher& operator=(const WorkspaceWatcher&) = delete;
+
+	bool Open(const std::filesystem::path& workspace) {
+		root = workspace;
+#ifdef __linux__
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyFd < 0) {
+			errorMessage = std::format("inotify_init1 failed: {}", std::strerror(errno));
+			return false;
+		}
+		if (!AddWatch(workspace)) {
+			return false;
+		}
+		std::error_code ec;
+		for (auto it = std::filesystem::recursive_directory_iterator(workspace, ec);
+			!ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+			if (it->is_directory(ec)) {
+				AddWatch(it->path());
+			}
+		}
+		return true;
+#else
+		Scan(snapshot);
+		return true;
+#endif
+	}
+
+	const std::string& ErrorMessage() const {
+		return errorMessage;
+	}
+
+	/**
+	 * @brief: 等待文件修改
+	 * @param timeout: 等待第一个事件的最长时间, 负数表示一直等待
+	 * @return: 修改过的 Lua 文件, 超时返回空
+	 */
+	std::vector<std::filesystem::path> Wait(std::chrono::milliseconds timeout = std::chrono::milliseconds(-1),
+		std::chrono::milliseconds settle = std::chrono::milliseconds(50)) {
+		std::vector<std::filesystem::path> changed;
+#ifdef __linux__
+		if (inotifyFd < 0) {
+			return changed;
+		}
+		pollfd pfd {inotifyFd, POLLIN, 0};
+		int waitMs = static_cast<int>(timeout.count());
+		while (::poll(&pfd, 1, waitMs) > 0) {
+			ReadEvents(changed);
+			waitMs = static_cast<int>(settle.count());
+		}
+#else
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (changed.empty()) {
+			std::unordered_map<std::string, std::filesystem::file_time_type> current;
+			Scan(current);
+			for (const auto& [path, time] : current) {
+				auto it = snapshot.find(path);
+				if (it == snapshot.end() || it->second != time) {
+					changed.emplace_back(path);
+				}
+			}
+			snapshot = std::move(current);
+			if (!changed.empty() || (timeout.count() >= 0 && std::chrono::steady_clock::now() >= deadline)) {
+				break;
+			}
+			std::this_thread::sleep_for(PollInterval);
+		}
+#endif
+		return changed;
+	}
+
+private:
+	static bool IsLuaSource(const std::filesystem::path& path) {
+		const std::string name = path.filename().string();
+		if (name.empty() || name.front() == '.' || name.back() == '~') {
+			return false;
+		}
+		const auto extension = path.extension();
+		return extension == ".lua" || extension == ".luac";
+	}
+
+#ifdef __linux__
+	bool AddWatch(const std::filesystem::path& dir) {
+		int wd = inotify_add_watch(inotifyFd, dir.c_str(),
+			IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF);
+		if (wd < 0) {
+			errorMessage = std::format("inotify_add_watch {} failed: {}", dir.string(), std::strerror(errno));
+			return false;
+		}
+		watches[wd] = dir;
+		return true;
+	}
+
+	void ReadEvents(std::vector<std::filesystem::path>& changed) {
+		alignas(inotify_event) char buffer[16 * 1024];
+		ssize_t bytes = 0;
+		while ((bytes = ::read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+			for (char* p = buffer; p < buffer + bytes;) {
+				auto* event = reinterpret_cast<inotify_event*>(p);
+				p += sizeof(inotify_event) + event->len;
+				auto it = watches.find(event->wd);
+				if (it == watches.end()) {
+					continue;
+				}
+				if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+					watches.erase(it);
+					continue;
+				}
+				if (event->len == 0) {
+					continue;
+				}
+				std::filesystem::path path = it->second / event->name;
+				if (event->mask & IN_ISDIR) {
+					if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+						AddWatch(path);
+					}
+					continue;
+				}
+				/* 只有 IN_CREATE 时文件还没写完, 等 IN_CLOSE_WRITE */
+				if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && IsLuaSource(path) &&
+					std::find(changed.begin(), changed.end(), path) == changed.end()) {
+					changed.push_back(std::move(path));
+				}
+			}
+		}
+	}
+#else
+	static constexpr std::chrono::milliseconds PollInterval {200};
+
+	void Scan(std::unordered_map<std::string, std::filesystem::file_time_type>& files) const {
+		std::error_code ec;
+		for (auto it = std::filesystem::recursive_directory_iterator(root, ec);
+			!ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+			if (it->is_regular_file(ec) && IsLuaSource(it->path())) {
+				files[it->path().string()] = it->last_write_time(ec);
+			}
+		}
+	}
+#endif
+
+private:
+	std::filesystem::path root {};
+	std::string errorMessage {""};
+#ifdef __linux__
+	int inotifyFd {-1};
+	std::unordered_map<int, std::filesystem::path> watches {};
+#else
+	std::unordered_map<std::string, std::filesystem::file_time_type> snapshot {};
+#endif
+};
+
+/* 一轮测量的汇总 */
+struct WatchIterationStats {
+	uint64_t runs {0};
+	double meanUs {0.0};
+	double minUs {0.0};
+	double p50Us {0.0};
+	double p99Us {0.0};
+	double p999Us {0.0};
+	double maxUs {0.0};
+	double allocatedKB {0.0};
+	std::optional<CallTreeProfile> profile {};
+};
+
+struct WatchSessionOptions {
+	std::string args {""};
+	uint64_t repeat {100};
+	uint64_t maxIterations {0};   /* 0 表示一直监视 */
+	size_t profileRows {0};       /* 大于 0 时记录调用树, 每轮打印变化最大的函数 */
+};
+
+/**
+ * @brief: 监视模式: 先测量一轮作为基线, 之后每次工作空间中的文件被保存,
+ *     在同一个预热的虚拟机上热重载被修改的模块 (LuaVM::ReloadModules) 并重新测量,
+ *     立即打印与上一轮的对比; 重载或运行失败时保留上一轮作为对比基线
+ */
+inline static int RunWatchSession(const std::filesystem::path& workspace, const std::string& entry,
+	const WatchSessionOptions& options, std::ostream& out) {
+	LuaVM vm(workspace, entry);
+	if (!vm.IsValid()) {
+		out << std::format("watch: create vm failed: {}\n", vm.GetLog());
+		return 1;
+	}
+	WorkspaceWatcher watcher;
+	if (!watcher.Open(workspace)) {
+		out << std::format("watch: {}\n", watcher.ErrorMessage());
+		return 1;
+	}
+
+	auto measure = [&](std::string& error) -> std::optional<WatchIterationStats> {
+		if (options.profileRows > 0) {
+			vm.EnableCallTree();
+		}
+		LatencyHistogram latency;
+		uint64_t allocated = 0;
+		for (uint64_t i = 0; i < options.repeat; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			LuaResult ret = vm.Run(options.args);
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			if (!ret.bSuccess) {
+				error = ret.msgError;
+				vm.DisableCallTree();
+				return std::nullopt;
+			}
+			latency.Record(static_cast<uint64_t>(ns));
+			allocated += ret.luaMemory.allocatedBytes;
+		}
+		WatchIterationStats stats;
+		stats.runs = latency.Count();
+		stats.meanUs = latency.Mean() / 1e3;
+		stats.minUs = latency.Min() / 1e3;
+		stats.p50Us = latency.Percentile(0.50) / 1e3;
+		stats.p99Us = latency.Percentile(0.99) / 1e3;
+		stats.p999Us = latency.Percentile(0.999) / 1e3;
+		stats.maxUs = latency.Max() / 1e3;
+		stats.allocatedKB = static_cast<double>(allocated) / static_cast<double>(stats.runs) / 1024.0;
+		if (const CallTreeProfile* tree = vm.CallTree()) {
+			stats.profile = *tree;
+		}
+		vm.DisableCallTree();
+		return stats;
+	};
+	auto change = [](double before, double after) -> std::string {
+		if (before <= 0.0) return "";
+		return std::format(" ({:+.1f}%)", (after - before) * 100.0 / before);
+	};
+	auto print = [&](uint64_t iteration, const WatchIterationStats& stats, const WatchIterationStats* previous) {
+		out << std::format("[#{}] runs={} mean={:.2f}us{} p50={:.2f}us{} p99={:.2f}us{} p99.9={:.2f}us{} min={:.2f}us max={:.2f}us alloc/run={:.1f}KB{}\n",
+			iteration, stats.runs,
+			stats.meanUs, previous ? change(previous->meanUs, stats.meanUs) : "",
+			stats.p50Us, previous ? change(previous->p50Us, stats.p50Us) : "",
+			stats.p99Us, previous ? change(previous->p99Us, stats.p99Us) : "",
+			stats.p999Us, previous ? change(previous->p999Us, stats.p999Us) : "",
+			stats.minUs, stats.maxUs,
+			stats.allocatedKB, previous ? change(previous->allocatedKB, stats.allocatedKB) : "");
+		if (previous && previous->profile && stats.profile) {
+			ProfileDiff(*previous->profile, *stats.profile).Print(out, options.profileRows);
+		}
+		out.flush();
+	};
+
+	std::string error;
+	auto baseline = measure(error);
+	if (!baseline) {
+		out << std::format("[#0] run failed: {}\n", error);
+	} else {
+		print(0, *baseline, nullptr);
+	}
+	out << std::format("watching {} (Ctrl-C to stop)\n", workspace.string());
+	out.flush();
+
+	for (uint64_t iteration = 1; options.maxIterations == 0 || iteration <= options.maxIterations; ++iteration) {
+		auto changed = watcher.Wait();
+		if (changed.empty()) {
+			--iteration;
+			continue;
+		}
+		std::string files;
+		for (const auto& path : changed) {
+			files += " " + std::filesystem::relative(path, workspace).string();
+		}
+		std::vector<std::string> reloaded;
+		LuaResult reload = vm.ReloadModules(changed, &reloaded);
+		std::string modules;
+		for (const auto& name : reloaded) {
+			modules += " " + name;
+		}
+		out << std::format("[#{}] changed:{} reloaded:{}\n", iteration, files, modules.empty() ? " -" : modules);
+		if (!reload.bSuccess) {
+			out << std::format("[#{}] {}\n", iteration, reload.msgError);
+			continue;
+		}
+		auto stats = measure(error);
+		if (!stats) {
+			out << std::format("[#{}] run failed: {}\n", iteration, error);
+			continue;
+		}
+		print(iteration, *stats, baseline ? &*baseline : nullptr);
+		baseline = std::move(stats);
+	}
+	return 0;
+}
+
+} // namespace LuaBenchmark
@@ -4,6 +4,7 @@
 #include <thread>
 #include <type_traits>
 #include "Logger.hpp"
+#include "CommandParser.hpp"
 //#include "LuaVM.hpp"
 //using namespace LuaBenchmark;
 
@@ -36,9 +37,7 @@ void TestLog2() {
         std::cout << "\n--- Simulating some operations ---" << std::endl;
         
         for (int i = 1; i <= 3; ++i) {
-            logger.Log(Level::INFO, 
-                      std::format("Processing item {}", i), 
-                      Output::BOTH);
+            logger.Log(Level::INFO, Output::BOTH, "Processing item {}", i);
             
             // 模拟处理时间
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -134,7 +133,10 @@ void TestLuaVM() {
     std::cout << "Test LuaVM Over" << std::endl;
 }
 
-int main(){
+int main(int argc, char** argv){
+    if (argc > 1) {
+        return entry(argc, argv);
+    }
     TestLuaVM();
     TestLog2();
     return 0;
@@ -5,8 +5,15 @@
 #include <thread>
 #include <string>
 #include <optional>
+#include <vector>
 #include "lua.hpp" // LuaJIT 头文件
+#include "CallTree.hpp"
+#include "LatencyHistogram.hpp"
+#include "LiveMetrics.hpp"
+#include "Logger.hpp"
 #include "LuaVM.hpp"
+#include "PerfCounters.hpp"
+#include "SystemInfo.hpp"
 #include "Tools.hpp"
 
 #ifdef _WIN32
@@ -25,6 +32,191 @@
 //     }
 //     return 0;
 // }
+/*
+ * @brief: 运行环境指纹, 由 old_main 在绑核/调整优先级之后采集, 写入结果文件的 context
+ */
+static std::optional<LuaBenchmark::EnvironmentFingerprint> benchmarkFingerprint {std::nullopt};
+
+static const LuaBenchmark::EnvironmentFingerprint& GetBenchmarkFingerprint() {
+    if (!benchmarkFingerprint.has_value()) {
+        benchmarkFingerprint = LuaBenchmark::CollectEnvironmentFingerprint();
+    }
+    return benchmarkFingerprint.value();
+}
+
+/*
+ * @brief: --live_metrics=<name> 时各模块用例把进度发布到共享内存, 用 `--top <name>` 查看
+ */
+static std::shared_ptr<LuaBenchmark::LiveMetricsPublisher> benchLiveMetrics {nullptr};
+
+/*
+ * @brief: 每个用例的单次迭代延迟直方图, 重复运行 (Repetitions) 合并到同一个直方图
+ *     --latency_out=<file> 时结束后写成只有延迟注释行的折叠栈文件, 多次运行的文件用 --latency 合并查看
+ */
+static LuaBenchmark::CallTreeProfile benchLatencies {};
+static std::string benchLatencyOut {""};
+
+/*
+ * @brief: 把延迟分位数写入 benchmark counters (us)
+ */
+static void ReportLatency(benchmark::State& state, const std::string& name, const LuaBenchmark::LatencyHistogram& latency) {
+    if (latency.Count() == 0) {
+        return;
+    }
+    state.counters["p50_us"] = benchmark::Counter(latency.Percentile(0.50) / 1e3);
+    state.counters["p90_us"] = benchmark::Counter(latency.Percentile(0.90) / 1e3);
+    state.counters["p99_us"] = benchmark::Counter(latency.Percentile(0.99) / 1e3);
+    state.counters["p999_us"] = benchmark::Counter(latency.Percentile(0.999) / 1e3);
+    state.counters["max_us"] = benchmark::Counter(latency.Max() / 1e3);
+    benchLatencies.MergeLatency(benchLatencies.InternFunction(name), latency);
+}
+
+/*
+ * @brief: 把累计的性能计数器写入 benchmark counters (按迭代取平均)
+ * @note: 计数器不可用时 (容器, 权限不足) 只打印一次原因, 不影响计时结果
+ */
+static void ReportPerfCounters(benchmark::State& state, const LuaBenchmark::PerfCounters& perf) {
+    if (!perf.Available()) {
+        static bool bWarned = false;
+        if (!bWarned) {
+            std::cout << "Perf counters unavailable: " << perf.UnavailableReason() << std::endl;
+            bWarned = true;
+        }
+        return;
+    }
+    const auto& totals = perf.Totals();
+    for (size_t i = 0; i < LuaBenchmark::PerfEventCount; ++i) {
+        auto event = static_cast<LuaBenchmark::PerfEvent>(i);
+        if (!totals.Has(event)) {
+            continue;
+        }
+        state.counters[std::string(LuaBenchmark::PerfCounters::Name(event))] =
+            benchmark::Counter(totals.Get(event), benchmark::Counter::kAvgIterations);
+    }
+    if (totals.Has(LuaBenchmark::PerfEvent::CYCLES) && totals.Has(LuaBenchmark::PerfEvent::INSTRUCTIONS)) {
+        state.counters["IPC"] = benchmark::Counter(totals.IPC());
+    }
+}
+
+/*
+ * @brief: 汇总内存统计: 堆峰值与 RSS 增量取最大值, 其余累加后按迭代取平均
+ */
+struct MemoryStatsAccumulator {
+    size_t peakHeapBytes = 0;
+    int64_t rssDeltaBytes = 0;
+    double fullGCCycles = 0.0;
+    double incrementalGCCycles = 0.0;
+    double allocatedBytes = 0.0;
+    double reclaimedBytes = 0.0;
+
+    void Add(const LuaBenchmark::LuaMemoryStats& memory) {
+        peakHeapBytes = std::max(peakHeapBytes, memory.peakHeapBytes);
+        rssDeltaBytes = std::max(rssDeltaBytes, memory.rssDeltaBytes);
+        fullGCCycles += static_cast<double>(memory.fullGCCycles);
+        incrementalGCCycles += static_cast<double>(memory.incrementalGCCycles);
+        allocatedBytes += static_cast<double>(memory.allocatedBytes);
+        reclaimedBytes += static_cast<double>(memory.reclaimedBytes);
+    }
+
+    void Report(benchmark::State& state) const {
+        state.counters["PeakHeap_KB"] = benchmark::Counter(peakHeapBytes / 1024.0);
+        state.counters["RSSDelta_KB"] = benchmark::Counter(rssDeltaBytes / 1024.0);
+        state.counters["FullGC"] = benchmark::Counter(fullGCCycles, benchmark::Counter::kAvgIterations);
+        state.counters["IncGC"] = benchmark::Counter(incrementalGCCycles, benchmark::Counter::kAvgIterations);
+        state.counters["Allocated_KB"] = benchmark::Counter(allocatedBytes / 1024.0, benchmark::Counter::kAvgIterations);
+        state.counters["Reclaimed_KB"] = benchmark::Counter(reclaimedBytes / 1024.0, benchmark::Counter::kAvgIterations);
+    }
+};
+
+/*
+ * @brief: 单个模块的基准上下文
+ *     新建 Lua 虚拟机并 require 模块, 模块返回的函数保存在注册表中,
+ *     每次迭代只调用该函数, 不包含虚拟机创建与模块加载的开销
+ */
+class LuaModuleCase {
+public:
+    explicit LuaModuleCase(const std::string& moduleName) {
+        auto workspace = GetLuaWorkpace();
+        if (!workspace.has_value()) {
+            errorMessage = "LuaModuleCase: Lua workspace not found";
+            return;
+        }
+        L = luaL_newstate();
+        if (!L) {
+            errorMessage = "LuaModuleCase: Failed to create Lua state";
+            return;
+        }
+        luaL_openlibs(L);
+
+        lua_getglobal(L, "package");
+        lua_getfield(L, -1, "path");
+        std::string path = std::string(lua_tostring(L, -1)) + ";" + workspace.value().string() + "/?.lua";
+        lua_pop(L, 1);
+        lua_pushstring(L, path.c_str());
+        lua_setfield(L, -2, "path");
+        lua_pop(L, 1);
+
+        lua_getglobal(L, "require");
+        lua_pushstring(L, moduleName.c_str());
+        if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+            const char* error = lua_tostring(L, -1);
+            errorMessage = std::format("LuaModuleCase: require '{}' failed: {}", moduleName, error ? error : "unknown");
+            lua_pop(L, 1);
+            return;
+        }
+        if (!lua_isfunction(L, -1)) {
+            errorMessage = std::format("LuaModuleCase: module '{}' did not return a function", moduleName);
+            lua_pop(L, 1);
+            return;
+        }
+        funcRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    ~LuaModuleCase() {
+        if (L) lua_close(L);
+    }
+    LuaModuleCase(const LuaModuleCase&) = delete;
+    LuaModuleCase& operator=(const LuaModuleCase&) = delete;
+
+    bool IsValid() const {
+        return L != nullptr && funcRef != LUA_NOREF;
+    }
+    const std::string& ErrorMessage() const {
+        return errorMessage;
+    }
+    lua_State* State() const {
+        return L;
+    }
+
+    /* 调用模块函数, 成功时把返回的数值写入 result; size 作为负载规模传给入口函数 */
+    bool Call(double& result, std::optional<lua_Number> size = std::nullopt) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
+        int nargs = 0;
+        if (size.has_value()) {
+            lua_pushnumber(L, size.value());
+            nargs = 1;
+        }
+        if (lua_pcall(L, nargs, 1, 0) != LUA_OK) {
+            const char* error = lua_tostring(L, -1);
+            errorMessage = error ? error : "Unknown Lua error";
+            lua_pop(L, 1);
+            return false;
+        }
+        if (!lua_isnumber(L, -1)) {
+            errorMessage = "Lua function did not return a number";
+            lua_pop(L, 1);
+            return false;
+        }
+        result = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+        return true;
+    }
+
+private:
+    lua_State* L {nullptr};
+    int funcRef {LUA_NOREF};
+    std::string errorMessage {""};
+};
+
 static void BM_RunLuaScript(benchmark::State& state) {
     // 预先获取路径
     std::string scriptPath = GetLuaCodePath("main").value();
@@ -41,6 +233,8 @@ static void BM_RunLuaScript(benchmark::State& state) {
         std::chrono::nanoseconds slowest_run = std::chrono::nanoseconds::min();
         std::chrono::nanoseconds total_time = std::chrono::nanoseconds(0);
     } stats;
+    MemoryStatsAccumulator memoryStats;
+    LuaBenchmark::LatencyHistogram latency;
     
     // 预热运行，输出初始信息
     {
@@ -55,13 +249,16 @@ static void BM_RunLuaScript(benchmark::State& state) {
     
     std::cout << "\n====== Starting Benchmark ======" << std::endl;
     
+    LuaBenchmark::PerfCounters perf;
     // 性能测试循环
     for (auto _ : state) {
         auto start = std::chrono::high_resolution_clock::now();
+        perf.Start();
         
         // 被测量的代码
         auto result = LuaBenchmark::RunLuaScript(scriptPath);
         
+        perf.Stop();
         auto end = std::chrono::high_resolution_clock::now();
         auto duration = end - start;
         
@@ -74,6 +271,7 @@ static void BM_RunLuaScript(benchmark::State& state) {
             stats.total_result += result.luaResult;
             stats.min_result = std::min(stats.min_result, result.luaResult);
             stats.max_result = std::max(stats.max_result, result.luaResult);
+            memoryStats.Add(result.memory);
             
             // 记录时间信息
             stats.total_time += std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
@@ -81,6 +279,8 @@ static void BM_RunLuaScript(benchmark::State& state) {
                                        std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
             stats.slowest_run = std::max(stats.slowest_run, 
                                        std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
+            latency.Record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
         } else {
             state.SkipWithError(result.ErrorMessage.c_str());
             break;
@@ -117,10 +317,24 @@ static void BM_RunLuaScript(benchmark::State& state) {
         std::chrono::duration_cast<std::chrono::microseconds>(stats.fastest_run).count());
     state.counters["SlowestRun_us"] = benchmark::Counter(
         std::chrono::duration_cast<std::chrono::microseconds>(stats.slowest_run).count());
+
+    // 单次运行的延迟分位数 (p50/p90/p99/p99.9/max)
+    ReportLatency(state, "BM_RunLuaScript", latency);
+    // 硬件性能计数器 (cycles, instructions, IPC, cache/branch misses, 上下文切换)
+    ReportPerfCounters(state, perf);
+    // Lua 堆峰值, RSS 增量, GC 周期与回收字节数
+    memoryStats.Report(state);
     
     // 可以添加系统信息
     std::cout << "\n====== System Info ======" << std::endl;
     std::cout << "CPU cores: " << std::thread::hardware_concurrency() << std::endl;
+    const auto& fingerprint = GetBenchmarkFingerprint();
+    for (const auto& [key, value] : fingerprint.Fields()) {
+        std::cout << key << ": " << value << std::endl;
+    }
+    for (const auto& warning : fingerprint.Warnings()) {
+        std::cout << "Warning: " << warning << std::endl;
+    }
     
     #ifdef _WIN32
     MEMORYSTATUSEX memInfo;
@@ -144,20 +358,315 @@ BENCHMARK(BM_RunLuaScript)
     ->Repetitions(3)  // 重复整个测试3次
     ->DisplayAggregatesOnly(false);  // 显示每次迭代的详细信息
 
+/*
+ * @brief: 单独测量一个模块返回的函数, 用来对比不同类型负载 (整数循环 / 浮点 / 三角函数) 的硬件行为
+ */
+static void BM_RunLuaModule(benchmark::State& state, const std::string& moduleName) {
+    LuaModuleCase luaCase(moduleName);
+    if (!luaCase.IsValid()) {
+        state.SkipWithError(luaCase.ErrorMessage().c_str());
+        return;
+    }
+
+    LuaBenchmark::PerfCounters perf;
+    // 在 luaCase 之后声明, 保证先于 lua_close 析构; 整个用例只采样一次 /proc, 不干扰单次计时
+    LuaBenchmark::LuaMemoryTracker memoryTracker(luaCase.State());
+    std::optional<LuaBenchmark::LiveMetricsRecorder> liveMetrics;
+    if (benchLiveMetrics) {
+        liveMetrics.emplace(benchLiveMetrics, luaCase.State(), moduleName);
+    }
+    memoryTracker.BeginRun();
+    LuaBenchmark::LatencyHistogram latency;
+    double result = 0.0;
+    // 计数器在整个循环外开关一次 (ioctl 与 read 不进入单次计时), ReportPerfCounters 按迭代取平均
+    perf.Start();
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        bool bSuccess = luaCase.Call(result);
+        if (!bSuccess) {
+            state.SkipWithError(luaCase.ErrorMessage().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(result);
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        latency.Record(static_cast<uint64_t>(elapsed.count()));
+        // 发布要排序延迟样本并查询 jit 状态, 不计入迭代时间
+        if (liveMetrics && liveMetrics->RecordRun(static_cast<uint64_t>(elapsed.count()), true)) {
+            state.PauseTiming();
+            liveMetrics->Publish(memoryTracker.CurrentHeapBytes(), memoryTracker.TotalGCCycles());
+            state.ResumeTiming();
+        }
+    }
+    perf.Stop();
+
+    MemoryStatsAccumulator memoryStats;
+    memoryStats.Add(memoryTracker.EndRun());
+
+    state.counters["Result"] = benchmark::Counter(result);
+    ReportLatency(state, moduleName, latency);
+    ReportPerfCounters(state, perf);
+    memoryStats.Report(state);
+}
+
+BENCHMARK_CAPTURE(BM_RunLuaModule, mod1, std::string("mod1"))->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_RunLuaModule, mod2, std::string("mod2"))->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_RunLuaModule, mod3, std::string("mod3"))->Unit(benchmark::kMicrosecond);
+
+/*
+ * @brief: 把 state.range(0) 作为负载规模传入模块入口函数, 扫描规模并拟合复杂度
+ * @note: 报告末尾的 _BigO 行给出拟合出的阶和系数, _RMS 行给出拟合误差
+ */
+static void BM_RunLuaModuleScaled(benchmark::State& state, const std::string& moduleName) {
+    LuaModuleCase luaCase(moduleName);
+    if (!luaCase.IsValid()) {
+        state.SkipWithError(luaCase.ErrorMessage().c_str());
+        return;
+    }
+
+    const auto size = static_cast<lua_Number>(state.range(0));
+    double result = 0.0;
+    for (auto _ : state) {
+        if (!luaCase.Call(result, size)) {
+            state.SkipWithError(luaCase.ErrorMessage().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetComplexityN(state.range(0));
+}
+
+#define LUA_SCALED_BENCHMARK(name)                                             \
+    BENCHMARK_CAPTURE(BM_RunLuaModuleScaled, name, std::string(#name))         \
+        ->RangeMultiplier(4)                                                   \
+        ->Range(1 << 8, 1 << 18)                                               \
+        ->Complexity()                                                         \
+        ->Unit(benchmark::kMicrosecond)
+
+LUA_SCALED_BENCHMARK(mod1);
+LUA_SCALED_BENCHMARK(mod2);
+LUA_SCALED_BENCHMARK(mod3);
+
+/*
+ * @brief: 贴近真实业务的负载语料 (Lua/corpus/), 每个模块返回 function(n)
+ *     - 默认规模: 报告性能计数器与内存统计
+ *     - 规模扫描: 拟合复杂度
+ */
+static const std::vector<std::string> LuaCorpus = {
+    "string_build",       // 字符串拼接与模式匹配
+    "table_ops",          // 表插入/删除与哈希访问
+    "closures",           // 闭包与上值
+    "coroutine_pingpong", // 协程切换
+    "ffi_structs",        // FFI 结构体数组
+    "gc_churn",           // 大量短命对象
+    "pcall_errors",       // pcall 错误路径
+    "json_codec",         // 类 JSON 编解码
+};
+
+static bool RegisterLuaCorpus() {
+    for (const auto& name : LuaCorpus) {
+        const std::string moduleName = "corpus." + name;
+        benchmark::RegisterBenchmark(("BM_LuaCorpus/" + name).c_str(), BM_RunLuaModule, moduleName)
+            ->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("BM_LuaCorpusScaled/" + name).c_str(), BM_RunLuaModuleScaled, moduleName)
+            ->RangeMultiplier(4)
+            ->Range(1 << 6, 1 << 14)
+            ->Complexity()
+            ->Unit(benchmark::kMicrosecond);
+    }
+    return true;
+}
+static const bool bLuaCorpusRegistered = RegisterLuaCorpus();
+
+/*
+ * @brief: 启动时间: 从创建 LuaVM 到入口函数第一次调用返回 (Lua/startup.lua)
+ *     Arg(0) 为标准库清单: 0 全部, 1 base,package, 2 base,math,string,jit,ffi
+ *     Arg(1) 为 1 时每次迭代清空工作空间缓存, 对比缓存前后的差距
+ *     上一次迭代的虚拟机在暂停计时后销毁, lua_close 不计入启动时间
+ */
+static void BM_LuaVMStartup(benchmark::State& state) {
+    auto workspace = GetLuaWorkpace();
+    if (!workspace.has_value()) {
+        state.SkipWithError("Lua workspace not found");
+        return;
+    }
+    static const std::vector<std::string> manifests = {"all", "base,package", "base,math,string,jit,ffi"};
+    std::string error;
+    auto libs = LuaBenchmark::LuaLibManifest::Parse(manifests[static_cast<size_t>(state.range(0))], error);
+    const bool bColdCache = state.range(1) != 0;
+    std::optional<LuaBenchmark::LuaVM> vm;
+    for (auto _ : state) {
+        state.PauseTiming();
+        vm.reset();
+        if (bColdCache) {
+            LuaBenchmark::LuaWorkspaceCache::Instance().Clear();
+        }
+        state.ResumeTiming();
+        vm.emplace(workspace.value(), "startup::startup", libs.value());
+        auto ret = vm->Run("");
+        if (!ret.bSuccess) {
+            state.SkipWithError(ret.msgError.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(ret.luaResult);
+    }
+    state.SetLabel(libs->ToString() + (bColdCache ? " cold-cache" : ""));
+}
+BENCHMARK(BM_LuaVMStartup)
+    ->ArgsProduct({{0, 1, 2}, {0, 1}})
+    ->ArgNames({"libs", "cold"})
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * @brief: 钩子事件吞吐量 (事件/秒): 入口函数循环调用空函数, 每次调用产生调用与返回两个事件, 事件记录到调用树
+ *     事件数取钩子实际送达的数量, 包括主 chunk, 入口函数与 tonumber 的事件
+ *     Arg(0) 为 0 时每个事件都 lua_getinfo("nSl") (符号缓存之前的做法), 为 1 时按函数对象查符号缓存
+ */
+static void BM_HookEventThroughput(benchmark::State& state) {
+    auto workspace = GetLuaWorkpace();
+    if (!workspace.has_value()) {
+        state.SkipWithError("Lua workspace not found");
+        return;
+    }
+    constexpr int64_t CallsPerRun = 10000;
+    const std::string args = std::to_string(CallsPerRun);
+    LuaBenchmark::LuaVM vm(workspace.value(), "hook_events::hook_events");
+    vm.SetSymbolCache(state.range(0) != 0);
+    vm.EnableCallTree();
+    const uint64_t eventsBefore = vm.HookEvents();
+    for (auto _ : state) {
+        auto ret = vm.Run(args);
+        if (!ret.bSuccess) {
+            state.SkipWithError(ret.msgError.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(ret.luaResult);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(vm.HookEvents() - eventsBefore));
+    state.SetLabel(state.range(0) != 0 ? "symbol-cache" : "getinfo-nSl");
+}
+BENCHMARK(BM_HookEventThroughput)
+    ->ArgName("cache")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * @brief: 日志吞吐量 (行/秒), Arg(0) 为同步写, Arg(1) 为异步批量写
+ *     items_per_second 是调用方看到的吞吐, DurableLinesPerSec 额外包含析构时的最终写出与落盘
+ */
+static std::unique_ptr<Logger> benchLogger {nullptr};
+static std::chrono::steady_clock::time_point benchLoggerStart {};
+
+static void BM_LoggerThroughput(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        const std::filesystem::path path = "./Log/logger_throughput.log";
+        std::filesystem::remove(path);
+        benchLogger = std::make_unique<Logger>("Bench: ", "", "", path,
+            state.range(0) == 0 ? LogMode::SYNC : LogMode::ASYNC);
+        benchLoggerStart = std::chrono::steady_clock::now();
+    }
+    const std::string message = std::format("thread {} writes a typical benchmark log line", state.thread_index());
+    for (auto _ : state) {
+        benchLogger->Log(Level::INFO, message, Output::FILE);
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        benchLogger.reset();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - benchLoggerStart).count();
+        state.counters["DurableLinesPerSec"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * state.threads() / seconds);
+    }
+}
+BENCHMARK(BM_LoggerThroughput)
+    ->ArgName("async")
+    ->Arg(0)
+    ->Arg(1)
+    ->Threads(1)
+    ->Threads(4)
+    ->Iterations(200000)
+    ->UseRealTime();
+
+/*
+ * @brief: 基准测试入口
+ *    --pin_cpu=<n>     把基准线程绑定到第 n 号 CPU (sched_setaffinity)
+ *    --raise_priority  在权限允许的范围内提高调度优先级
+ *    --live_metrics=<name>  把模块用例的实时指标发布到共享内存 /luaprofile.<name>
+ *    --latency_out=<file>  把每个用例的延迟直方图写入 file (用 --latency 查看或合并多次运行)
+ *    其余参数原样交给 google benchmark (可覆盖默认的 JSON 输出参数)
+ */
 int old_main(int argc, char** argv) {
+    int pinCpu = -1;
+    bool bRaisePriority = false;
+    std::vector<char*> forwardArgs;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--pin_cpu=", 0) == 0) {
+            try {
+                pinCpu = std::stoi(arg.substr(std::string("--pin_cpu=").size()));
+            } catch (const std::exception&) {
+                std::cerr << "Invalid --pin_cpu value: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg == "--raise_priority") {
+            bRaisePriority = true;
+        } else if (arg.rfind("--live_metrics=", 0) == 0) {
+            benchLiveMetrics = std::make_shared<LuaBenchmark::LiveMetricsPublisher>();
+            if (!benchLiveMetrics->Open(arg.substr(std::string("--live_metrics=").size()))) {
+                std::cerr << "Warning: " << benchLiveMetrics->ErrorMessage() << std::endl;
+                benchLiveMetrics.reset();
+            }
+        } else if (arg.rfind("--latency_out=", 0) == 0) {
+            benchLatencyOut = arg.substr(std::string("--latency_out=").size());
+        } else {
+            forwardArgs.push_back(argv[i]);
+        }
+    }
+
+    // 降噪: 绑核与提高优先级都在采集指纹之前完成, 指纹记录实际生效的状态
+    std::string pinnedCpu = "none";
+    if (pinCpu >= 0) {
+        if (auto error = LuaBenchmark::PinCurrentThread(pinCpu)) {
+            std::cerr << "Warning: " << error.value() << std::endl;
+        } else {
+            pinnedCpu = std::to_string(pinCpu);
+        }
+    }
+    std::string priority = bRaisePriority ? LuaBenchmark::RaiseCurrentThreadPriority() : "unchanged";
+
+    benchmarkFingerprint = LuaBenchmark::CollectEnvironmentFingerprint(pinCpu);
+    benchmarkFingerprint->pinnedCpu = pinnedCpu;
+    benchmarkFingerprint->priority = priority;
+    for (const auto& warning : benchmarkFingerprint->Warnings()) {
+        std::cerr << "Warning: " << warning << std::endl;
+    }
+
     // 添加 JSON 输出参数
-    const char* json_args[] = {
+    std::vector<char*> benchArgs = {
         argv[0],
-        "--benchmark_format=json",
-        "--benchmark_out=lua_benchmark_results.json"
+        const_cast<char*>("--benchmark_format=json"),
+        const_cast<char*>("--benchmark_out=lua_benchmark_results.json")
     };
-    int json_argc = sizeof(json_args) / sizeof(json_args[0]);
+    benchArgs.insert(benchArgs.end(), forwardArgs.begin(), forwardArgs.end());
+    int benchArgc = static_cast<int>(benchArgs.size());
     
     // 初始化并运行基准测试
-    ::benchmark::Initialize(&json_argc, const_cast<char**>(json_args));
+    ::benchmark::Initialize(&benchArgc, benchArgs.data());
+    // 每个结果文件都带上环境指纹, 不同机器的结果才能放在一起比较
+    for (const auto& [key, value] : benchmarkFingerprint->Fields()) {
+        ::benchmark::AddCustomContext(key, value);
+    }
     ::benchmark::RunSpecifiedBenchmarks();
     
     std::cout << "Benchmark results have been saved to lua_benchmark_results.json" << std::endl;
+    if (!benchLatencyOut.empty()) {
+        if (benchLatencies.SaveCollapsed(benchLatencyOut)) {
+            std::cout << "Latency histograms have been saved to " << benchLatencyOut << std::endl;
+        } else {
+            std::cerr << "Warning: write " << benchLatencyOut << " failed" << std::endl;
+        }
+    }
+    benchLiveMetrics.reset();
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CallTree.hpp"
+#include "ChromeTrace.hpp"
+#include "TraceFormat.hpp"
+
+using namespace LuaBenchmark;
+
+/*
+ * 二进制 trace 离线解码工具
+ *   LuaTraceDecoder <trace file> [--text | --json | --profile | --chrome <output> | --collapsed <output>]
+ *     --text:    每行一个事件 (默认)
+ *     --json:    事件数组
+ *     --profile: 按函数汇总调用次数, 总时间与自身时间
+ *     --chrome:  转换为 Chrome Trace Event JSON 时间线, 用 Perfetto UI 打开
+ *     --collapsed: 转换为调用上下文树的折叠栈, 可以用 --diff 与另一份比较 (trace 中没有分配量)
+ */
+
+static const char* KindName(TraceRecordKind kind) {
+    switch (kind) {
+        case TraceRecordKind::CALL: return "call";
+        case TraceRecordKind::RETURN: return "return";
+        case TraceRecordKind::HEAP: return "heap";
+        default: return "unknown";
+    }
+}
+
+static std::string EscapeJson(const std::string& str) {
+    std::string out;
+    out.reserve(str.size() + 2);
+    for (char c : str) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += std::format("\\u{:04x}", static_cast<unsigned char>(c));
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+static void PrintText(const TraceReader& reader) {
+    reader.ForEachEvent([&](const TraceEvent& event) {
+        std::cout << std::format("{:>14} thread {:<4} {:<6} {}\n",
+            event.timestampNs, event.thread, KindName(event.kind),
+            event.kind == TraceRecordKind::HEAP ? std::format("{} KB", event.id) : reader.Name(event.id));
+    });
+}
+
+static void PrintJson(const TraceReader& reader) {
+    std::cout << "[\n";
+    bool bFirst = true;
+    reader.ForEachEvent([&](const TraceEvent& event) {
+        if (event.kind == TraceRecordKind::HEAP) {
+            std::cout << std::format("{}  {{\"ts_ns\": {}, \"thread\": {}, \"event\": \"heap\", \"heap_kb\": {}}}",
+                bFirst ? "" : ",\n", event.timestampNs, event.thread, event.id);
+        } else {
+            std::cout << std::format("{}  {{\"ts_ns\": {}, \"thread\": {}, \"event\": \"{}\", \"name\": \"{}\"}}",
+                bFirst ? "" : ",\n", event.timestampNs, event.thread, KindName(event.kind),
+                EscapeJson(reader.Name(event.id)));
+        }
+        bFirst = false;
+    });
+    std::cout << "\n]\n";
+}
+
+static void PrintProfile(const TraceReader& reader) {
+    struct Frame {
+        uint32_t id;
+        uint64_t start;
+        uint64_t childNs;
+    };
+    struct FunctionStats {
+        uint64_t calls = 0;
+        uint64_t inclusiveNs = 0;
+        uint64_t selfNs = 0;
+    };
+    std::unordered_map<uint32_t, std::vector<Frame>> stacks;
+    std::unordered_map<uint32_t, FunctionStats> stats;
+
+    reader.ForEachEvent([&](const TraceEvent& event) {
+        if (event.kind == TraceRecordKind::HEAP) {
+            return;
+        }
+        auto& stack = stacks[event.thread];
+        if (event.kind == TraceRecordKind::CALL) {
+            stack.push_back({event.id, event.timestampNs, 0});
+            return;
+        }
+        // 调用事件在被覆盖的块里, 无法配对
+        if (stack.empty()) {
+            return;
+        }
+        Frame frame = stack.back();
+        stack.pop_back();
+        uint64_t inclusive = event.timestampNs - frame.start;
+        auto& s = stats[frame.id];
+        s.calls++;
+        s.inclusiveNs += inclusive;
+        s.selfNs += inclusive > frame.childNs ? inclusive - frame.childNs : 0;
+        if (!stack.empty()) {
+            stack.back().childNs += inclusive;
+        }
+    });
+
+    std::vector<std::pair<uint32_t, FunctionStats>> sorted(stats.begin(), stats.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second.selfNs > b.second.selfNs;
+    });
+    std::cout << std::format("{:>10} {:>14} {:>14}  {}\n", "calls", "self_us", "total_us", "function");
+    for (const auto& [id, s] : sorted) {
+        std::cout << std::format("{:>10} {:>14.1f} {:>14.1f}  {}\n",
+            s.calls, s.selfNs / 1000.0, s.inclusiveNs / 1000.0, reader.Name(id));
+    }
+}
+
+/*
+ * 每个 trace 线程 (lua_State) 一条轨道, 堆大小写成计数器轨道
+ * 开头的块被覆盖时, 没有配对调用的返回事件直接丢弃, 保证切片嵌套正确
+ */
+static bool WriteChrome(const TraceReader& reader, const std::string& output) {
+    ChromeTraceWriter writer;
+    if (!writer.Open(output)) {
+        std::cerr << "Error: " << writer.ErrorMessage() << "\n";
+        return false;
+    }
+    constexpr uint64_t pid = 1;
+    writer.ProcessName(pid, "Lua trace");
+    std::unordered_map<uint32_t, size_t> depth;
+    reader.ForEachEvent([&](const TraceEvent& event) {
+        const uint64_t tid = event.thread + 1;
+        if (event.kind == TraceRecordKind::HEAP) {
+            writer.Counter(pid, event.timestampNs, "Lua heap", "KB", static_cast<double>(event.id));
+            return;
+        }
+        auto [it, bInserted] = depth.try_emplace(event.thread, 0);
+        if (bInserted) {
+            writer.ThreadName(pid, tid, std::format("lua thread {}", event.thread),
+                static_cast<int64_t>(event.thread));
+        }
+        if (event.kind == TraceRecordKind::CALL) {
+            writer.Begin(pid, tid, event.timestampNs, reader.Name(event.id));
+            it->second++;
+        } else if (it->second > 0) {
+            writer.End(pid, tid, event.timestampNs);
+            it->second--;
+        }
+    });
+    writer.Close();
+    return true;
+}
+
+/*
+ * 每个 trace 线程一个调用栈, 协程中的调用挂在根节点下, 与运行时构建的调用树一致
+ */
+static bool WriteCollapsed(const TraceReader& reader, const std::string& output) {
+    struct Frame {
+        uint32_t node;
+        uint64_t start;
+        uint64_t childNs;
+    };
+    CallTreeProfile tree;
+    std::unordered_map<uint32_t, uint32_t> functions;
+    std::unordered_map<uint32_t, std::vector<Frame>> stacks;
+    reader.ForEachEvent([&](const TraceEvent& event) {
+        if (event.kind == TraceRecordKind::HEAP) {
+            return;
+        }
+        auto& stack = stacks[event.thread];
+        if (event.kind == TraceRecordKind::CALL) {
+            auto [it, bInserted] = functions.try_emplace(event.id, 0);
+            if (bInserted) {
+                it->second = tree.InternFunction(reader.Name(event.id));
+            }
+            uint32_t parent = stack.empty() ? CallTreeProfile::Root : stack.back().node;
+            stack.push_back({tree.Child(parent, it->second), event.timestampNs, 0});
+            return;
+        }
+        if (stack.empty()) {
+            return;
+        }
+        Frame frame = stack.back();
+        stack.pop_back();
+        uint64_t inclusive = event.timestampNs - frame.start;
+        tree.Add(frame.node, 1, inclusive > frame.childNs ? inclusive - frame.childNs : 0, 0);
+        tree.RecordLatency(tree.Nodes()[frame.node].function, inclusive);
+        if (!stack.empty()) {
+            stack.back().childNs += inclusive;
+        }
+    });
+    if (!tree.SaveCollapsed(output)) {
+        std::cerr << "Error: write " << output << " failed\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <trace file> [--text | --json | --profile | --chrome <output> | --collapsed <output>]\n";
+        return 1;
+    }
+    std::string mode = argc > 2 ? argv[2] : "--text";
+
+    TraceReader reader;
+    if (!reader.Open(argv[1])) {
+        std::cerr << "Error: " << reader.ErrorMessage() << "\n";
+        return 1;
+    }
+    const auto& header = reader.Header();
+    std::cerr << std::format("chunks written: {}, ring chunks: {}, dropped strings: {}\n",
+        header.nextChunkSeq, header.ringChunks, header.droppedStrings);
+
+    if (mode == "--text") {
+        PrintText(reader);
+    } else if (mode == "--json") {
+        PrintJson(reader);
+    } else if (mode == "--profile") {
+        PrintProfile(reader);
+    } else if (mode == "--chrome") {
+        if (argc < 4) {
+            std::cerr << "--chrome requires an output file\n";
+            return 1;
+        }
+        if (!WriteChrome(reader, argv[3])) {
+            return 1;
+        }
+    } else if (mode == "--collapsed") {
+        if (argc < 4) {
+            std::cerr << "--collapsed requires an output file\n";
+            return 1;
+        }
+        if (!WriteCollapsed(reader, argv[3])) {
+            return 1;
+        }
+    } else {
+        std::cerr << "Unknown output mode: " << mode << "\n";
+        return 1;
+    }
+    return 0;
+}